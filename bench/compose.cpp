@@ -0,0 +1,82 @@
+#include "fixtures.h"
+#include "cache.h"
+#include "canvas.h"
+#include "config.h"
+#include "displays.h"
+#include "wallpapers.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+enum class ComposeCache {
+    None,
+    Derivative,
+    Decoded,
+};
+
+void BM_FillPlaceholder(benchmark::State& state)
+{
+    ResetBenchConfig();
+    displays = CreateBenchLayout(1, 2560, 1440);
+    Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, false);
+    PixelView view = GetCanvasView(canvas, displays[0]);
+
+    for (auto _ : state) {
+        ApplyPlaceholderToWallpaperBuffer(view);
+        benchmark::DoNotOptimize(view.data);
+    }
+
+    state.SetBytesProcessed(state.iterations() * view.width * view.height * 3);
+    ReleaseCanvases();
+}
+
+void BM_ComposeDisplays(benchmark::State& state)
+{
+    size_t display_count = static_cast<size_t>(state.range(0));
+    ComposeCache cache = static_cast<ComposeCache>(state.range(1));
+
+    ResetBenchConfig();
+    config->derivativeCacheSize = cache == ComposeCache::Derivative ? 2048 : 0;
+    config->decodeCacheSize = cache == ComposeCache::Decoded ? 256 : 0;
+    ClearDecodedImageCache();
+
+    displays = CreateBenchLayout(display_count, 2560, 1440);
+    std::string image_path = GetBenchImage("jpg", 3840, 2160);
+
+    std::vector<CompositeJob> jobs;
+    for (const Display& display : displays) {
+        jobs.push_back({ display, image_path });
+    }
+
+    Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, false);
+
+    // the first pass fills whichever cache is measured
+    ComposeDirtyDisplays(canvas, jobs);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (const Display& display : displays) {
+            MarkRegionDirty(canvas, display);
+        }
+        state.ResumeTiming();
+
+        ComposeDirtyDisplays(canvas, jobs);
+    }
+
+    state.SetItemsProcessed(state.iterations() * display_count);
+    ReleaseCanvases();
+    ClearDecodedImageCache();
+}
+
+BENCHMARK(BM_FillPlaceholder)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ComposeDisplays)
+    ->ArgNames({ "displays", "cache" })
+    ->ArgsProduct({ { 1, 2, 3, 4, 6 }, { static_cast<int>(ComposeCache::None), static_cast<int>(ComposeCache::Derivative), static_cast<int>(ComposeCache::Decoded) } })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}
\ No newline at end of file
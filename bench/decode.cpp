@@ -0,0 +1,53 @@
+#include "fixtures.h"
+#include "canvas.h"
+#include "wallpapers.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+void BM_DecodePNG(benchmark::State& state)
+{
+    uint16_t width = static_cast<uint16_t>(state.range(0));
+    uint16_t height = static_cast<uint16_t>(state.range(1));
+    std::string path = GetBenchImage("png", width, height);
+
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+    PixelView view = { pixels.data(), width * 3, width, height };
+
+    for (auto _ : state) {
+        ApplyPNGToWallpaperBuffer(view, path);
+        benchmark::DoNotOptimize(pixels.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+
+void BM_DecodeJPEG(benchmark::State& state)
+{
+    uint16_t width = static_cast<uint16_t>(state.range(0));
+    uint16_t height = static_cast<uint16_t>(state.range(1));
+    unsigned int scale_denom = static_cast<unsigned int>(state.range(2));
+    std::string path = GetBenchImage("jpg", width, height);
+
+    uint16_t out_width = static_cast<uint16_t>((width + scale_denom - 1) / scale_denom);
+    uint16_t out_height = static_cast<uint16_t>((height + scale_denom - 1) / scale_denom);
+    std::vector<uint8_t> pixels(static_cast<size_t>(out_width) * out_height * 3);
+    PixelView view = { pixels.data(), out_width * 3, out_width, out_height };
+
+    for (auto _ : state) {
+        ApplyJPEGToWallpaperBuffer(view, path, scale_denom);
+        benchmark::DoNotOptimize(pixels.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+
+BENCHMARK(BM_DecodePNG)->Args({ 1920, 1080 })->Args({ 3840, 2160 })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DecodeJPEG)->Args({ 1920, 1080, 1 })->Args({ 3840, 2160, 1 })->Args({ 3840, 2160, 2 })->Unit(benchmark::kMillisecond);
+
+}
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "fixtures.h"
+#include "config.h"
+#include "paths.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <jpeglib.h>
+#include <png.h>
+
+namespace wallflow {
+
+std::string GetBenchDir()
+{
+    return (std::filesystem::temp_directory_path() / "wallflow_bench").string();
+}
+
+std::string GetBenchPath(const std::string& path)
+{
+    return (std::filesystem::path(GetBenchDir()) / path).string();
+}
+
+void InitBenchEnvironment()
+{
+    std::filesystem::create_directories(GetBenchDir());
+
+    // keeps the metadata index, derivatives and canvases out of the real AppData
+#ifdef _WIN32
+    _putenv_s("XDG_DATA_HOME", GetBenchDir().c_str());
+#else
+    setenv("XDG_DATA_HOME", GetBenchDir().c_str(), 1);
+#endif
+
+    ResetBenchConfig();
+    CreateAppDataDir();
+}
+
+void ResetBenchConfig()
+{
+    if (config == nullptr) {
+        config = new Config;
+    }
+
+    config->wallpaperDir = GetBenchPath("library");
+    config->wallpaperDirs = {};
+    config->cycleSpeed = 300;
+    config->shuffle = false;
+    config->decodeCacheSize = 0;
+    config->derivativeCacheSize = 0;
+    config->largePages = false;
+    config->preRenderLead = 0;
+    config->repoRescanInterval = 0;
+    config->imageFormat = "bmp";
+    config->jpegQuality = 95;
+    config->pngCompressionLevel = 1;
+    config->pngFilter = "sub";
+    config->placement = "fill";
+    config->resampleFilter = "lanczos3";
+    config->displayPlacement = {};
+}
+
+// gradients with some noise, so the encoders and decoders see photo-like data
+std::vector<uint8_t> CreateBenchPixels(uint16_t width, uint16_t height)
+{
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+    std::mt19937 rng(width * 31 + height);
+    std::uniform_int_distribution<int> noise(-8, 8);
+
+    for (uint16_t y = 0; y < height; y++) {
+        for (uint16_t x = 0; x < width; x++) {
+            uint8_t* pixel = pixels.data() + (static_cast<size_t>(y) * width + x) * 3;
+            pixel[0] = static_cast<uint8_t>(std::clamp(x * 255 / width + noise(rng), 0, 255));
+            pixel[1] = static_cast<uint8_t>(std::clamp(y * 255 / height + noise(rng), 0, 255));
+            pixel[2] = static_cast<uint8_t>(std::clamp((x + y) * 127 / (width + height) + noise(rng), 0, 255));
+        }
+    }
+    return pixels;
+}
+
+void WriteBenchPNG(const std::string& path, uint16_t width, uint16_t height)
+{
+    std::vector<uint8_t> pixels = CreateBenchPixels(width, height);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error(std::format("could not create bench image ({})", path));
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png_create_info_struct(png);
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        throw std::runtime_error(std::format("could not write bench image ({})", path));
+    }
+
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    for (uint16_t y = 0; y < height; y++) {
+        png_write_row(png, pixels.data() + static_cast<size_t>(y) * width * 3);
+    }
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+}
+
+void WriteBenchJPEG(const std::string& path, uint16_t width, uint16_t height)
+{
+    std::vector<uint8_t> pixels = CreateBenchPixels(width, height);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error(std::format("could not create bench image ({})", path));
+    }
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, file);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = pixels.data() + static_cast<size_t>(cinfo.next_scanline) * width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    fclose(file);
+}
+
+std::string GetBenchImage(const std::string& format, uint16_t width, uint16_t height)
+{
+    std::filesystem::create_directories(GetBenchPath("images"));
+    std::string path = GetBenchPath(std::format("images/{}x{}.{}", width, height, format));
+
+    // generated once and kept between runs, the encoders are slower than what is measured
+    if (std::filesystem::exists(path)) {
+        return path;
+    }
+
+    if (format == "png") {
+        WriteBenchPNG(path, width, height);
+    } else if (format == "jpg") {
+        WriteBenchJPEG(path, width, height);
+    } else {
+        throw std::runtime_error(std::format("unsupported bench image format ({})", format));
+    }
+    return path;
+}
+
+std::vector<Display> CreateBenchLayout(size_t display_count, uint16_t width, uint16_t height)
+{
+    std::vector<Display> layout;
+
+    // side by side, the most common way displays are arranged
+    for (size_t i = 0; i < display_count; i++) {
+        Display display;
+        display.repoKey = std::format("{}x{}", width, height);
+        display.id = std::format("BENCH{}:{}", i, display.repoKey);
+        display.alias = display.repoKey;
+        display.x = static_cast<int16_t>(i * width);
+        display.y = 0;
+        display.width = width;
+        display.height = height;
+        layout.push_back(display);
+    }
+    return layout;
+}
+
+// header-only pngs are enough, verification never reads past IHDR
+void WriteBenchPNGHeader(const std::string& path, uint16_t width, uint16_t height)
+{
+    const uint8_t header[33] = {
+        0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A,
+        0, 0, 0, 13, 'I', 'H', 'D', 'R',
+        0, 0, static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        0, 0, static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        8, 2, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    std::ofstream out_file(path, std::ios::binary | std::ios::trunc);
+    out_file.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+std::string CreateBenchLibrary(size_t file_count, uint16_t width, uint16_t height)
+{
+    std::string root = GetBenchPath(std::format("library_{}", file_count));
+    std::filesystem::path repo = std::filesystem::path(root) / std::format("{}x{}", width, height);
+    std::filesystem::path marker = std::filesystem::path(root) / "complete";
+
+    if (std::filesystem::exists(marker)) {
+        return root;
+    }
+
+    // a thousand files per folder, like an archive sorted by date
+    for (size_t i = 0; i < file_count; i++) {
+        std::filesystem::path dir = repo / std::format("{:04}", i / 1000);
+        if (i % 1000 == 0) {
+            std::filesystem::create_directories(dir);
+        }
+        WriteBenchPNGHeader((dir / std::format("image_{:06}.png", i)).string(), width, height);
+    }
+
+    std::ofstream(marker.string()).put('1');
+    return root;
+}
+
+}
\ No newline at end of file
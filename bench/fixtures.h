@@ -0,0 +1,19 @@
+#pragma once
+
+#include "displays.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+std::string GetBenchDir();
+std::string GetBenchPath(const std::string& path);
+void InitBenchEnvironment();
+void ResetBenchConfig();
+std::string GetBenchImage(const std::string& format, uint16_t width, uint16_t height);
+std::vector<Display> CreateBenchLayout(size_t display_count, uint16_t width, uint16_t height);
+std::string CreateBenchLibrary(size_t file_count, uint16_t width, uint16_t height);
+
+}
\ No newline at end of file
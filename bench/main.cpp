@@ -0,0 +1,36 @@
+#include "fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace wallflow;
+
+int main(int argc, char** argv)
+{
+    // json unless asked otherwise, so runs can be diffed and tracked in CI
+    std::vector<char*> args(argv, argv + argc);
+    bool has_format = false;
+    for (char* arg : args) {
+        if (std::strncmp(arg, "--benchmark_format", 18) == 0) {
+            has_format = true;
+        }
+    }
+
+    char json_format[] = "--benchmark_format=json";
+    if (!has_format) {
+        args.push_back(json_format);
+    }
+
+    int arg_count = static_cast<int>(args.size());
+    benchmark::Initialize(&arg_count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(arg_count, args.data())) {
+        return 1;
+    }
+
+    InitBenchEnvironment();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "fixtures.h"
+#include "canvas.h"
+#include "displays.h"
+#include "encoders.h"
+#include "wallpapers.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+void BenchEncode(benchmark::State& state, const std::string& format)
+{
+    ResetBenchConfig();
+    displays = CreateBenchLayout(static_cast<size_t>(state.range(0)), 2560, 1440);
+
+    std::unique_ptr<OutputEncoder> encoder = CreateOutputEncoder(format, 95, 1, "sub");
+    Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, encoder->EncodesInPlace());
+
+    // placeholder regions plus the gradient image, something between the best and worst case for the encoders
+    std::string image_path = GetBenchImage("jpg", 3840, 2160);
+    std::vector<CompositeJob> jobs;
+    for (size_t i = 0; i < displays.size(); i++) {
+        jobs.push_back({ displays[i], i % 2 == 0 ? image_path : "" });
+    }
+    ComposeDirtyDisplays(canvas, jobs);
+
+    for (auto _ : state) {
+        EncodeResult result = encoder->Encode(canvas);
+        benchmark::DoNotOptimize(result.bytesWritten);
+        state.counters["bytes"] = static_cast<double>(result.bytesWritten);
+    }
+
+    state.SetBytesProcessed(state.iterations() * canvas.size.width * canvas.size.height * 3);
+    ReleaseCanvases();
+}
+
+// bmp encodes in place and measures next to nothing here, its real cost is the
+// page faults composition takes on the mapped canvas in BM_ComposeDisplays
+void BM_EncodeBMP(benchmark::State& state)
+{
+    BenchEncode(state, "bmp");
+}
+
+void BM_EncodePNG(benchmark::State& state)
+{
+    BenchEncode(state, "png");
+}
+
+void BM_EncodeJPEG(benchmark::State& state)
+{
+    BenchEncode(state, "jpg");
+}
+
+BENCHMARK(BM_EncodeBMP)->ArgName("displays")->Arg(1)->Arg(3)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EncodePNG)->ArgName("displays")->Arg(1)->Arg(3)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EncodeJPEG)->ArgName("displays")->Arg(1)->Arg(3)->Unit(benchmark::kMillisecond);
+
+}
\ No newline at end of file
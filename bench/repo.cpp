@@ -0,0 +1,91 @@
+#include "fixtures.h"
+#include "config.h"
+#include "metadata.h"
+#include "repo.h"
+#include "walk.h"
+#include "watch.h"
+
+#include <benchmark/benchmark.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+std::vector<std::string> GetBenchLibraryFiles(size_t file_count)
+{
+    std::string root = CreateBenchLibrary(file_count, 2560, 1440);
+    return WalkFilesWithExtensions({ root }, { "png" });
+}
+
+void BM_WalkLibrary(benchmark::State& state)
+{
+    size_t file_count = static_cast<size_t>(state.range(0));
+    std::string root = CreateBenchLibrary(file_count, 2560, 1440);
+
+    for (auto _ : state) {
+        std::vector<std::string> files = WalkFilesWithExtensions({ root }, { "png", "jpg", "jpeg" });
+        benchmark::DoNotOptimize(files.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * file_count);
+}
+
+void BM_ProbeLibraryCold(benchmark::State& state)
+{
+    size_t file_count = static_cast<size_t>(state.range(0));
+    std::vector<std::string> files = GetBenchLibraryFiles(file_count);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (const std::string& file : files) {
+            RemoveImageMetadata(file);
+        }
+        state.ResumeTiming();
+
+        std::vector<std::optional<ImageMetadata>> metadata = GetImagesMetadata(files);
+        benchmark::DoNotOptimize(metadata.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * file_count);
+}
+
+void BM_ProbeLibraryWarm(benchmark::State& state)
+{
+    size_t file_count = static_cast<size_t>(state.range(0));
+    std::vector<std::string> files = GetBenchLibraryFiles(file_count);
+    GetImagesMetadata(files);
+
+    for (auto _ : state) {
+        std::vector<std::optional<ImageMetadata>> metadata = GetImagesMetadata(files);
+        benchmark::DoNotOptimize(metadata.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * file_count);
+}
+
+void BM_PopulateRepo(benchmark::State& state)
+{
+    size_t file_count = static_cast<size_t>(state.range(0));
+
+    ResetBenchConfig();
+    config->wallpaperDir = CreateBenchLibrary(file_count, 2560, 1440);
+
+    // the index is warm after the first population, like every start but the first
+    PopulateRepo(2560, 1440);
+
+    for (auto _ : state) {
+        PopulateRepo(2560, 1440);
+    }
+
+    state.SetItemsProcessed(state.iterations() * file_count);
+    StopDirectoryWatcher();
+}
+
+BENCHMARK(BM_WalkLibrary)->ArgName("files")->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ProbeLibraryCold)->ArgName("files")->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ProbeLibraryWarm)->ArgName("files")->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_PopulateRepo)->ArgName("files")->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}
\ No newline at end of file
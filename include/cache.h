@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+struct DecodedImage {
+    uint16_t width;
+    uint16_t height;
+    std::vector<uint8_t> pixels;
+};
+
+struct DecodedImageCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+    std::string ToString();
+};
+
+std::shared_ptr<const DecodedImage> GetCachedImage(const std::string& path, uint16_t width, uint16_t height, const std::string& variant);
+void CacheImage(const std::string& path, uint16_t width, uint16_t height, const std::string& variant, std::shared_ptr<const DecodedImage> image);
+bool FitsDecodedImageCache(size_t size);
+void ClearDecodedImageCache();
+DecodedImageCacheStats GetDecodedImageCacheStats();
+
+}
\ No newline at end of file
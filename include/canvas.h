@@ -0,0 +1,60 @@
+#pragma once
+
+#include "displays.h"
+#include "mem.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+struct Dimensions {
+    uint16_t width;
+    uint16_t height;
+};
+
+struct PixelView {
+    uint8_t* data;
+    ptrdiff_t stride;
+    uint16_t width;
+    uint16_t height;
+};
+
+struct CanvasRegion {
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    std::string imagePath;
+};
+
+// The canvas always has the layout of a 24-bit BMP file: a fixed header
+// followed by bottom-up BGR rows padded to stride. When the output is BMP it
+// is a memory mapping of the final file, otherwise it lives in a pooled
+// anonymous buffer and is handed to an encoder.
+struct Canvas {
+    MemoryBufferHandle bufferHandle;
+    bool mapped;
+    uint8_t* ptr;
+    uint8_t* pixels;
+    size_t stride;
+    Dimensions size;
+    std::string path;
+    std::map<std::string, CanvasRegion> regions;
+    std::string ToString();
+};
+
+Dimensions GetCanvasSize();
+Canvas& AcquireCanvas(Dimensions size, const std::vector<Display>& layout, bool mapped);
+Canvas& AcquireBackCanvas(Dimensions size, const std::vector<Display>& layout, bool mapped);
+void SwapCanvases();
+PixelView GetCanvasView(const Canvas& canvas, const Display& display);
+bool IsRegionDirty(const Canvas& canvas, const Display& display, const std::string& image_path);
+void MarkRegionDirty(Canvas& canvas, const Display& display);
+void MarkRegionClean(Canvas& canvas, const Display& display, const std::string& image_path);
+void ReleaseCanvases();
+
+}
\ No newline at end of file
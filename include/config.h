@@ -1,13 +1,31 @@
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 
 namespace wallflow {
 
 struct Config {
     std::string wallpaperDir;
+    std::vector<std::string> wallpaperDirs;
     unsigned int cycleSpeed;
+    unsigned int cycleJitter;
     bool shuffle;
+    unsigned int decodeCacheSize;
+    unsigned int derivativeCacheSize;
+    bool largePages;
+    unsigned int preRenderLead;
+    unsigned int repoRescanInterval;
+    unsigned int metricsInterval;
+    std::string imageFormat;
+    int jpegQuality;
+    int pngCompressionLevel;
+    std::string pngFilter;
+    std::string placement;
+    std::string resampleFilter;
+    std::map<std::string, std::string> displayPlacement;
+    std::map<std::string, unsigned int> displayCycleSpeed;
     std::string ToString();
 };
 
@@ -18,11 +36,18 @@ std::string GetDisplayAliasPath();
 void LoadConfig();
 bool LoadConfigIfModified();
 void CreateDefaultConfig();
+void CreateDefaultConfig(const std::string& wallpaper_path);
 void SaveConfig();
 void CreateDisplayAliasFileIfNotFound();
 std::string GetDisplayAlias(std::string id);
 void SaveDisplayAlias(std::string id, std::string alias);
 std::string GetOrCreateAlias(std::string id, std::string alias);
+// reads the alias file again if it was modified since
+void RefreshDisplayAliases();
+// the same on the scheduler thread
+void RefreshDisplayAliasesLater();
+// writes alias changes the scheduler has not written yet
+void FlushDisplayAliases();
 void ChangeWallpaperDir();
 void ToggleShuffle();
 void SetCycleSpeed(int value);
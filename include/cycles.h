@@ -0,0 +1,16 @@
+#pragma once
+
+#include "displays.h"
+
+#include <chrono>
+
+namespace wallflow {
+
+std::chrono::seconds GetDisplayCycleInterval(const Display& display);
+// every display is cycled right away, then on its own interval
+void StartWallpaperCycles();
+// picks up changed cycle speeds and displays that came or went
+void RescheduleWallpaperCycles();
+void StopWallpaperCycles();
+
+}
\ No newline at end of file
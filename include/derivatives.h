@@ -0,0 +1,27 @@
+#pragma once
+
+#include "canvas.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace wallflow {
+
+struct DerivativeCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writes;
+    uint64_t evictions;
+    size_t files;
+    size_t bytes;
+    size_t budget;
+    std::string ToString();
+};
+
+std::string GetDerivativeCacheDir();
+bool LoadDerivative(const std::string& path, const std::string& variant, PixelView view);
+void StoreDerivative(const std::string& path, const std::string& variant, PixelView view);
+DerivativeCacheStats GetDerivativeCacheStats();
+
+}
\ No newline at end of file
@@ -21,5 +21,6 @@ struct Display {
 extern std::vector<Display> displays;
 
 void LoadDisplays();
+uint64_t GetDisplayGeneration();
 
 }
\ No newline at end of file
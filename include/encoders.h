@@ -0,0 +1,34 @@
+#pragma once
+
+#include "canvas.h"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace wallflow {
+
+struct EncodeResult {
+    std::string path;
+    size_t bytesWritten;
+    std::chrono::microseconds elapsed;
+    std::string ToString();
+};
+
+class OutputEncoder {
+public:
+    virtual ~OutputEncoder() = default;
+    virtual const char* Name() const = 0;
+    virtual const char* Extension() const = 0;
+    // whether the wallpaper engine can load the output
+    virtual bool IsDisplayable() const { return true; }
+    // whether the canvas mapping itself is the output file
+    virtual bool EncodesInPlace() const { return false; }
+    virtual EncodeResult Encode(const Canvas& canvas) = 0;
+};
+
+std::unique_ptr<OutputEncoder> CreateOutputEncoder(const std::string& format, int jpeg_quality, int png_compression_level, const std::string& png_filter);
+OutputEncoder& GetOutputEncoder();
+
+}
\ No newline at end of file
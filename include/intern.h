@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace wallflow {
+
+using ImageId = uint32_t;
+
+struct PathArenaStats {
+    size_t paths;
+    size_t dirs;
+    size_t bytes;
+    std::string ToString();
+};
+
+ImageId InternImagePath(const std::string& path);
+bool FindImagePath(const std::string& path, ImageId& id);
+std::string GetImagePath(ImageId id);
+bool ImagePathLess(ImageId id, const std::string& path);
+// true when some interned path lies below this folder, given with its trailing separator
+bool IsImageDirPrefix(const std::string& prefix);
+PathArenaStats GetPathArenaStats();
+
+}
\ No newline at end of file
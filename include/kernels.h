@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define WF_KERNELS_X86
+#endif
+
+namespace wallflow {
+
+enum class PixelFormat {
+    RGB,
+    BGR,
+    RGBA,
+    BGRA,
+    BGRX
+};
+
+template <PixelFormat Format>
+struct PixelLayout;
+
+template <>
+struct PixelLayout<PixelFormat::RGB> {
+    static constexpr int size = 3, r = 0, g = 1, b = 2, a = -1;
+};
+
+template <>
+struct PixelLayout<PixelFormat::BGR> {
+    static constexpr int size = 3, r = 2, g = 1, b = 0, a = -1;
+};
+
+template <>
+struct PixelLayout<PixelFormat::RGBA> {
+    static constexpr int size = 4, r = 0, g = 1, b = 2, a = 3;
+};
+
+template <>
+struct PixelLayout<PixelFormat::BGRA> {
+    static constexpr int size = 4, r = 2, g = 1, b = 0, a = 3;
+};
+
+template <>
+struct PixelLayout<PixelFormat::BGRX> {
+    static constexpr int size = 4, r = 2, g = 1, b = 0, a = 3;
+};
+
+// Reference conversion every SIMD kernel is checked against. src and dst may
+// alias when both formats have the same pixel size.
+template <PixelFormat Src, PixelFormat Dst>
+void ConvertPixelsScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    using S = PixelLayout<Src>;
+    using D = PixelLayout<Dst>;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t r = src[S::r];
+        uint8_t g = src[S::g];
+        uint8_t b = src[S::b];
+        uint8_t a = 0xFF;
+        if constexpr (S::a >= 0 && Dst != PixelFormat::BGRX) {
+            a = src[S::a];
+        }
+
+        dst[D::r] = r;
+        dst[D::g] = g;
+        dst[D::b] = b;
+        if constexpr (D::a >= 0) {
+            dst[D::a] = a;
+        }
+
+        src += S::size;
+        dst += D::size;
+    }
+}
+
+// Instantiated once in kernels.cpp so the SIMD translation units, which are
+// built with wider instruction sets, never emit their own copy.
+extern template void ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::RGB>(const uint8_t*, uint8_t*, size_t);
+extern template void ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::BGR>(const uint8_t*, uint8_t*, size_t);
+extern template void ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGR>(const uint8_t*, uint8_t*, size_t);
+extern template void ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGRX>(const uint8_t*, uint8_t*, size_t);
+extern template void ConvertPixelsScalar<PixelFormat::BGR, PixelFormat::BGRX>(const uint8_t*, uint8_t*, size_t);
+
+// Resampling weights are signed fixed point with this many fractional bits,
+// each output's weights sum to 1 << resample_precision.
+constexpr int resample_precision = 14;
+
+struct PixelKernels {
+    const char* name;
+    void (*rgbaToRgb)(const uint8_t* src, uint8_t* dst, size_t count);
+    void (*rgbaToBgr)(const uint8_t* src, uint8_t* dst, size_t count);
+    void (*swapRedBlue)(const uint8_t* src, uint8_t* dst, size_t count);
+    void (*rgbToBgrx)(const uint8_t* src, uint8_t* dst, size_t count);
+    void (*bgrToBgrx)(const uint8_t* src, uint8_t* dst, size_t count);
+    void (*fill)(uint8_t* dst, size_t count, const uint8_t* pixel);
+    void (*swapRows)(uint8_t* first, uint8_t* second, size_t size);
+    // dst pixel x = sum of taps BGR pixels of src starting at starts[x], weighted by weights[x * taps]
+    void (*resampleHorizontal)(const uint8_t* src, size_t src_width, uint8_t* dst, size_t dst_width, const int32_t* starts, const int16_t* weights, int taps);
+    // dst byte i = sum of rows[k][i] weighted by weights[k]
+    void (*resampleVertical)(const uint8_t* const* rows, uint8_t* dst, size_t size, const int16_t* weights, int taps);
+};
+
+const PixelKernels& GetScalarKernels();
+#ifdef WF_KERNELS_X86
+const PixelKernels& GetSSE2Kernels();
+const PixelKernels& GetSSSE3Kernels();
+const PixelKernels& GetAVX2Kernels();
+#endif
+// every table this CPU can run, scalar first and the one GetPixelKernels picks last
+std::vector<const PixelKernels*> GetSupportedPixelKernels();
+const PixelKernels& GetPixelKernels();
+void FlipRows(uint8_t* data, size_t stride, size_t rows);
+
+}
\ No newline at end of file
@@ -1,23 +1,26 @@
 /**
  * @file logging.h
- * @brief Logging and timer macros.
+ * @brief Logging macros, timing lives in trace.h.
+ *
+ * Callers format into a per-thread buffer and queue the line, a sink thread
+ * writes it to the console (debug builds) and to rotating files in AppData.
  */
 
 #pragma once
 
-#include <algorithm>
-#include <chrono>
-#include <ctime>
+#include <cstddef>
 #include <format>
-#include <iomanip>
-#include <iostream>
-#include <map>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 /**
  * @brief Enumeration representing different log levels.
  */
 enum class LogLevel {
+    LDEBUG, ///< Object dumps and other detail only useful while debugging.
     LINFO, ///< Informational messages.
     LWARNING, ///< Warning messages.
     LERROR, ///< Error messages.
@@ -28,17 +31,16 @@ enum class LogLevel {
 #define PROJECT_ROOT ""
 #endif
 
-#ifdef ENABLE_LOGGING
-
 /**
- * @brief Normalize file path by replacing backslashes with forward slashes.
- * @param path The file path to normalize.
- * @return The normalized file path.
+ * @brief Lowest level that is compiled in, everything below costs nothing.
  */
-std::string normalizeFilePath(const char* path);
-
-// Define a constant for the normalized project root path
-extern const std::string normalizedProjectRoot;
+#ifndef WF_LOG_LEVEL
+#ifdef ENABLE_LOGGING
+#define WF_LOG_LEVEL 0
+#else
+#define WF_LOG_LEVEL 1
+#endif
+#endif
 
 /**
  * @brief Convert log level enum to string.
@@ -47,107 +49,97 @@ extern const std::string normalizedProjectRoot;
  */
 std::string logLevelToString(LogLevel level);
 
+namespace wallflow {
+
 /**
- * @brief Prefix macro that adds filename, date, and time to log entries.
+ * @brief Length of the project root prefix of a source file path, separator included.
+ * @param file The source file path (__FILE__).
+ * @param root The project root (PROJECT_ROOT).
+ * @return The prefix length, or 0 when the file is not under the root.
  */
-#define WF_PREFIX()                                                           \
-    do {                                                                      \
-        auto current_time = std::chrono::system_clock::now();                 \
-        std::string file(normalizeFilePath(__FILE__));                        \
-        size_t rootPos = file.find(normalizedProjectRoot);                    \
-        if (rootPos != std::string::npos) {                                   \
-            file = file.substr(rootPos + normalizedProjectRoot.size());       \
-        }                                                                     \
-        std::time_t now = std::chrono::system_clock::to_time_t(current_time); \
-        std::cout << std::put_time(std::localtime(&now), "%F %T") << " ";     \
-        std::cout << file << ":" << __LINE__ << " ";                          \
-    } while (false)
+constexpr size_t GetLogFileOffset(std::string_view file, std::string_view root)
+{
+    if (root.empty() || file.size() <= root.size()) {
+        return 0;
+    }
+    for (size_t i = 0; i < root.size(); i++) {
+        char a = file[i] == '\\' ? '/' : file[i];
+        char b = root[i] == '\\' ? '/' : root[i];
+#ifdef _WIN32
+        a = static_cast<char>(a >= 'A' && a <= 'Z' ? a - 'A' + 'a' : a);
+        b = static_cast<char>(b >= 'A' && b <= 'Z' ? b - 'A' + 'a' : b);
+#endif
+        if (a != b) {
+            return 0;
+        }
+    }
+    char separator = file[root.size()];
+    return separator == '/' || separator == '\\' ? root.size() + 1 : 0;
+}
 
 /**
- * @brief Log macro that logs a message with a specified log level.
- * @param level The log level.
- * @param message The message to log.
+ * @brief Per-thread scratch buffer formatted messages are built in.
  */
-#define WF_LOG(level, message)                               \
-    do {                                                     \
-        WF_PREFIX();                                         \
-        std::cout << "[" << logLevelToString(level) << "] "; \
-        std::cout << message << std::endl;                   \
-    } while (false)
+std::string& GetLogBuffer();
 
 /**
- * @brief Map to store timer start times.
+ * @brief Queue a log line for the sink thread, never blocks on I/O.
+ * @param file The source file, relative to the project root.
  */
-extern std::map<std::string, std::chrono::high_resolution_clock::time_point> timer_times;
+void WriteLog(LogLevel level, const char* file, int line, std::string_view message);
+
+template <typename... Args>
+    requires(sizeof...(Args) > 0)
+void WriteLog(LogLevel level, const char* file, int line, std::format_string<Args...> fmt, Args&&... args)
+{
+    std::string& buffer = GetLogBuffer();
+    buffer.clear();
+    std::format_to(std::back_inserter(buffer), fmt, std::forward<Args>(args)...);
+    WriteLog(level, file, line, std::string_view(buffer));
+}
 
 /**
- * @brief Macro to start a timer with a given label.
- * @param label The label for the timer.
+ * @brief Start writing log files to the directory, rotating them by size.
  */
-#define WF_START_TIMER(label)                                           \
-    do {                                                                \
-        WF_PREFIX();                                                    \
-        timer_times[label] = std::chrono::high_resolution_clock::now(); \
-        std::cout << "[TIMER:" << label << "] ";                        \
-        std::cout << "STARTED" << std::endl;                            \
-    } while (false)
+void SetLogDirectory(const std::string& directory);
+
+/**
+ * @brief Block until every queued line has been written.
+ */
+void FlushLog();
+
+/**
+ * @brief Flush and stop the sink thread, later lines are written by the caller.
+ */
+void StopLogger();
+
+}
 
 /**
- * @brief Macro to end a timer with a given label.
- * @param label The label for the timer.
+ * @brief The source file of the log entry, trimmed at compile time.
  */
-#define WF_END_TIMER(label)                                                                                                   \
-    do {                                                                                                                      \
-        if (timer_times.find(label) != timer_times.end()) {                                                                   \
-            WF_PREFIX();                                                                                                      \
-            auto end_time = std::chrono::high_resolution_clock::now();                                                        \
-            auto elapsed_time = std::chrono::duration_cast<std::chrono::microseconds>(end_time - timer_times[label]).count(); \
-            std::cout << "[TIMER:" << label << "] ";                                                                          \
-            std::cout << "ENDED(" << std::format("{:.3f}", elapsed_time / 1e3) << "ms)" << std::endl;                         \
-        }                                                                                                                     \
+#define WF_LOG_FILE() (__FILE__ + std::integral_constant<size_t, ::wallflow::GetLogFileOffset(__FILE__, PROJECT_ROOT)>::value)
+
+/**
+ * @brief Log macro that logs a message with a specified log level.
+ * @param level The log level.
+ * @param ... The message, or a format string and its arguments.
+ */
+#define WF_LOG(level, ...)                                                     \
+    do {                                                                       \
+        if constexpr (static_cast<int>(level) >= WF_LOG_LEVEL) {               \
+            ::wallflow::WriteLog(level, WF_LOG_FILE(), __LINE__, __VA_ARGS__); \
+        }                                                                      \
     } while (false)
 
 /**
  * @brief Log macro that logs information about a pointer to an object.
  * @param obj The pointer to the object.
  */
-#define WF_LOG_OBJ_PTR(obj)                                     \
-    do {                                                        \
-        WF_PREFIX();                                            \
-        std::cout << "[OBJ*] " << obj->ToString() << std::endl; \
-    } while (false)
+#define WF_LOG_OBJ_PTR(obj) WF_LOG(LogLevel::LDEBUG, (obj)->ToString())
 
 /**
  * @brief Log macro that logs information about an object.
  * @param obj The object.
  */
-#define WF_LOG_OBJ(obj)                                       \
-    do {                                                      \
-        WF_PREFIX();                                          \
-        std::cout << "[OBJ] " << obj.ToString() << std::endl; \
-    } while (false)
-
-#else
-
-// Define empty macros when logging is disabled
-#define WF_LOG(level, message) \
-    do {                       \
-    } while (false)
-
-#define WF_START_TIMER(label) \
-    do {                      \
-    } while (false)
-
-#define WF_END_TIMER(label) \
-    do {                    \
-    } while (false)
-
-#define WF_LOG_OBJ_PTR(obj) \
-    do {                    \
-    } while (false)
-
-#define WF_LOG_OBJ(obj) \
-    do {                \
-    } while (false)
-
-#endif
\ No newline at end of file
+#define WF_LOG_OBJ(obj) WF_LOG(LogLevel::LDEBUG, (obj).ToString())
\ No newline at end of file
@@ -1,28 +1,44 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
-#define NOMINMAX
-
-#include <windows.h>
-
 namespace wallflow {
 
-struct FileMemoryBuffer {
-    uint16_t key;
+// slot index in the low 16 bits, slot generation in the high 16 bits, 0 is never handed out
+using MemoryBufferHandle = uint32_t;
+
+struct MemoryBuffer {
     uint8_t* ptr;
     size_t size;
-    HANDLE hFile;
-    HANDLE hMapFile;
-    LPVOID pMemory;
+    size_t capacity;
+    bool fileBacked;
+    bool largePages;
     std::string filePath;
+    // file and mapping object (Windows) or file descriptor (POSIX), owned by the MemoryMapper
+    intptr_t nativeFile;
+    intptr_t nativeMapping;
+    std::string ToString();
+};
+
+struct MemoryPoolStats {
+    uint64_t maps;
+    uint64_t reuses;
+    uint64_t unmaps;
+    size_t live;
+    size_t idle;
+    size_t idleBytes;
+    std::string ToString();
 };
 
-void DeleteFileMemoryBuffer(uint16_t key);
-FileMemoryBuffer GetFileMemoryBuffer(uint16_t key);
-uint16_t CreateFileMemoryBuffer(size_t size);
+MemoryBufferHandle CreateFileMemoryBuffer(std::string path, size_t size);
+MemoryBufferHandle AcquireMemoryBuffer(size_t size);
+MemoryBuffer GetMemoryBuffer(MemoryBufferHandle handle);
+void ReleaseMemoryBuffer(MemoryBufferHandle handle);
+void TrimMemoryBufferPool();
+MemoryPoolStats GetMemoryPoolStats();
 void RemoveOldFileMemoryBuffers();
-void DeleteAllFileMemoryBuffers();
+void DeleteAllMemoryBuffers();
 
 }
\ No newline at end of file
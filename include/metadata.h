@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+struct ImageMetadata {
+    uint64_t size;
+    int64_t modifiedAt;
+    int32_t format;
+    uint32_t width;
+    uint32_t height;
+    bool verified;
+    std::string ToString();
+};
+
+std::string GetMetadataIndexPath();
+bool GetImageMetadata(const std::string& path, ImageMetadata& metadata);
+std::vector<std::optional<ImageMetadata>> GetImagesMetadata(const std::vector<std::string>& paths);
+void RemoveImageMetadata(const std::string& path);
+void PruneImageMetadata(const std::string& dir_path, const std::vector<std::string>& files);
+void SaveMetadataIndex();
+
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace wallflow {
+
+class Counter {
+public:
+    void Add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value = 0;
+};
+
+class Gauge {
+public:
+    void Set(int64_t amount) { value.store(amount, std::memory_order_relaxed); }
+    void Add(int64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+    int64_t Get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value = 0;
+};
+
+// Log-linear buckets in the spirit of HdrHistogram: values under 32 are exact and
+// every power of two above is split in 32, so a percentile is off by at most 1/32.
+// Recording is a few relaxed atomic adds, readers see a slightly torn but usable view.
+class Histogram {
+public:
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) << sub_bucket_bits;
+
+    void Record(uint64_t value);
+    uint64_t Count() const;
+    uint64_t Sum() const;
+    uint64_t Max() const;
+    // the upper bound of the bucket holding the percentile (0 to 100), 0 without samples
+    uint64_t Percentile(double percentile) const;
+
+private:
+    static size_t GetBucket(uint64_t value);
+    static uint64_t GetBucketUpperBound(size_t bucket);
+
+    std::array<std::atomic<uint64_t>, bucket_count> buckets = {};
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint64_t> max = 0;
+};
+
+// records the time spent in the scope into a histogram, in microseconds
+class HistogramTimer {
+public:
+    explicit HistogramTimer(Histogram& histogram)
+        : histogram(histogram)
+        , start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~HistogramTimer()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    HistogramTimer(const HistogramTimer&) = delete;
+    HistogramTimer& operator=(const HistogramTimer&) = delete;
+
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Metrics are registered once and live for the process, call sites keep the
+// reference in a function local static. Labels are given in exposition form,
+// e.g. format="png", a name and labels pair always returns the same metric.
+Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+Histogram& GetHistogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+// every metric in the OpenMetrics text format, histograms as summaries
+std::string GetMetricsText();
+// one short line per metric, for the tray
+std::string GetMetricsSummary();
+void WriteMetrics(const std::string& path);
+void StartMetricsWriter(const std::string& path, unsigned int interval);
+void StopMetricsWriter();
+
+}
\ No newline at end of file
@@ -11,9 +11,10 @@ namespace wallflow {
 
 void CreateAppDataDir();
 std::string GetAppDataDir();
+void SetAppDataDir(const std::string& dir_path);
 std::string GetAppDataPath(std::string path);
 std::string GetUserDir();
 std::string GetUserPath(std::string path);
 std::string SelectDirectoryDialog();
-std::vector<std::string> GetFilesWithExtensions(const std::string& dir_path, const std::vector<std::string>& extensions);
+bool HasExtension(const std::string& path, const std::vector<std::string>& extensions);
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "displays.h"
+#include "mem.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+class DisplaySource {
+public:
+    virtual ~DisplaySource() = default;
+    virtual const char* Name() const = 0;
+    // appends every attached display in desktop coordinates, which may be negative
+    virtual bool Enumerate(std::vector<Display>& found) = 0;
+};
+
+class WallpaperTarget {
+public:
+    virtual ~WallpaperTarget() = default;
+    virtual const char* Name() const = 0;
+    virtual void Apply(const std::string& path) = 0;
+};
+
+// fills in ptr and the native handles of a MemoryBuffer, capacity is always a
+// multiple of the allocation granularity (or of the large page size)
+class MemoryMapper {
+public:
+    virtual ~MemoryMapper() = default;
+    virtual const char* Name() const = 0;
+    virtual bool EnableLargePages() = 0;
+    virtual size_t LargePageSize() const = 0;
+    virtual bool MapAnonymous(MemoryBuffer& buffer, bool large_pages) = 0;
+    virtual void MapFile(MemoryBuffer& buffer) = 0;
+    virtual void Unmap(MemoryBuffer& buffer) = 0;
+};
+
+std::unique_ptr<DisplaySource> CreateNativeDisplaySource();
+std::unique_ptr<DisplaySource> CreateStaticDisplaySource(std::vector<Display> layout);
+std::unique_ptr<WallpaperTarget> CreateNativeWallpaperTarget();
+std::unique_ptr<WallpaperTarget> CreateFileWallpaperTarget(std::string output_path);
+std::unique_ptr<MemoryMapper> CreateNativeMemoryMapper();
+
+// the native implementations are used until something else is set, which has
+// to happen before the first use
+DisplaySource& GetDisplaySource();
+void SetDisplaySource(std::unique_ptr<DisplaySource> source);
+WallpaperTarget& GetWallpaperTarget();
+void SetWallpaperTarget(std::unique_ptr<WallpaperTarget> target);
+MemoryMapper& GetMemoryMapper();
+
+}
\ No newline at end of file
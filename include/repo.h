@@ -1,5 +1,8 @@
 #pragma once
 
+#include "intern.h"
+
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
@@ -7,10 +10,11 @@
 namespace wallflow {
 
 extern std::map<std::string, int> repo_indexes;
-extern std::map<std::string, std::vector<std::string>> repo_files;
+extern std::map<std::string, std::vector<ImageId>> repo_files;
 
 void PopulateRepo(uint16_t width, uint16_t height);
 void PopulateAllRepos();
 std::string GetNextImage(uint16_t width, uint16_t height);
+uint64_t GetRepoGeneration();
 
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "canvas.h"
+
+#include <cstdint>
+#include <string>
+
+namespace wallflow {
+
+enum class ResampleFilter {
+    Box,
+    Bilinear,
+    Lanczos3
+};
+
+enum class Placement {
+    Fit,
+    Fill,
+    Center,
+    Stretch
+};
+
+// Where an image of a given size lands on a display: the source rectangle
+// that is sampled and the destination rectangle it is scaled into. Anything
+// outside the destination rectangle is background.
+struct PlacementGeometry {
+    double srcX;
+    double srcY;
+    double srcWidth;
+    double srcHeight;
+    uint16_t dstX;
+    uint16_t dstY;
+    uint16_t dstWidth;
+    uint16_t dstHeight;
+    std::string ToString();
+};
+
+ResampleFilter ParseResampleFilter(const std::string& name);
+Placement ParsePlacement(const std::string& name);
+const char* GetPlacementName(Placement placement);
+const char* GetResampleFilterName(ResampleFilter filter);
+PlacementGeometry GetPlacementGeometry(uint32_t src_width, uint32_t src_height, uint16_t dst_width, uint16_t dst_height, Placement placement);
+void Resample(PixelView src, double src_x, double src_y, double src_width, double src_height, PixelView dst, ResampleFilter filter);
+void PlaceImage(PixelView src, PixelView dst, Placement placement, ResampleFilter filter);
+
+}
\ No newline at end of file
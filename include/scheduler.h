@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace wallflow {
+
+using SchedulerClock = std::chrono::steady_clock;
+
+// One thread serves a heap of named timers and a queue of tasks. It sleeps until
+// the earliest deadline or until something is posted, nothing polls.
+void StartScheduler();
+// wakes the thread and joins it, only a job already running is waited for
+void StopScheduler();
+// replaces the pending timer of the same key
+void ScheduleTimer(const std::string& key, SchedulerClock::time_point due, std::function<void()> job);
+void CancelTimer(const std::string& key);
+// runs on the scheduler thread ahead of any due timer
+void PostSchedulerTask(std::function<void()> task);
+
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace wallflow {
+
+struct TraceStats {
+    uint64_t spans;
+    uint64_t dropped;
+    size_t threads;
+    std::string ToString();
+};
+
+// nanoseconds since the tracer started, the timebase of every exported event
+inline int64_t GetTraceTime()
+{
+    static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void RecordTraceSpan(const char* name, int64_t start, int64_t end);
+void SetTraceThreadName(const char* name);
+TraceStats GetTraceStats();
+// writes every span still held by the ring buffers as Chrome trace event JSON
+void ExportTrace(const std::string& path);
+
+// Times the enclosing scope. The name must outlive the process (a string
+// literal), only its pointer is stored.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name)
+        : name(name)
+        , start(GetTraceTime())
+    {
+    }
+
+    ~TraceSpan()
+    {
+        RecordTraceSpan(name, start, GetTraceTime());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+}
+
+#define WF_TRACE_CONCAT_INNER(a, b) a##b
+#define WF_TRACE_CONCAT(a, b) WF_TRACE_CONCAT_INNER(a, b)
+
+/**
+ * @brief Records the time spent in the current scope under a static label.
+ * @param label A string literal.
+ */
+#define WF_TRACE_SCOPE(label) ::wallflow::TraceSpan WF_TRACE_CONCAT(wf_trace_span_, __LINE__)(label)
\ No newline at end of file
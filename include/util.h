@@ -1,7 +0,0 @@
-#pragma once
-
-#include <algorithm>
-#include <string>
-#include <vector>
-
-bool StringVectorsMatch(const std::vector<std::string>& vector1, const std::vector<std::string>& vector2);
\ No newline at end of file
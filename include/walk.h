@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+std::vector<std::string> WalkFilesWithExtensions(const std::vector<std::string>& root_paths, const std::vector<std::string>& extensions);
+
+}
\ No newline at end of file
@@ -1,11 +1,30 @@
 #pragma once
 
+#include "canvas.h"
 #include "displays.h"
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace wallflow {
 
+struct CompositeJob {
+    Display display;
+    std::string imagePath;
+};
+
+unsigned int GetJPEGScaleDenominator(uint32_t width, uint32_t height, uint16_t target_width, uint16_t target_height);
+void ApplyPNGToWallpaperBuffer(PixelView view, std::string image_path);
+void ApplyJPEGToWallpaperBuffer(PixelView view, std::string image_path, unsigned int scale_denom);
+void ApplyPlaceholderToWallpaperBuffer(PixelView view);
+void ComposeDirtyDisplays(Canvas& canvas, const std::vector<CompositeJob>& jobs);
+
 void CycleAllDisplays();
 void CycleDisplay(Display selected_display);
+void CycleDisplays(const std::vector<Display>& selected_displays);
 void RedrawCurrent();
+void PrepareCycleAllDisplays();
+bool CommitPreparedCycle();
 
 }
\ No newline at end of file
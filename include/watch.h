@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+struct DirectoryChanges {
+    // the paths are incomplete (overflow, no watch, periodic rescan), list the directory again
+    bool rescan;
+    std::vector<std::string> paths;
+    std::string ToString();
+};
+
+void WatchDirectory(const std::string& dir_path);
+void MarkDirectoryScanned(const std::string& dir_path);
+bool TakeDirectoryChanges(const std::string& dir_path, DirectoryChanges& changes);
+void StopDirectoryWatcher();
+
+}
\ No newline at end of file
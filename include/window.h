@@ -2,6 +2,8 @@
 
 #include <string>
 
+#define NOMINMAX
+
 #include <windows.h>
 
 #define WM_TRAY_ICON (WM_USER + 1)
@@ -14,6 +16,8 @@
 #define TRAY_TOGGLE_SHUFFLE 6
 #define TRAY_SHOW_CYCLE_INTERVAL 7
 #define TRAY_SAVE_CYCLE_INTERVAL 8
+#define TRAY_EXPORT_TRACE 9
+#define TRAY_SHOW_METRICS 10
 
 #define TRAY_CYCLE_DISPLAY_OFFSET 1000
 
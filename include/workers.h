@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace wallflow {
+
+size_t GetWorkerCount(size_t task_count, size_t max_workers = 0);
+// Runs the tasks on a pool started once with a worker per core, the caller works
+// too. At most max_workers take part, nested calls share the same pool.
+void RunParallel(size_t task_count, const std::function<void(size_t)>& task, size_t max_workers = 0);
+void StopWorkerPool();
+
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "cache.h"
+#include "config.h"
+#include "log.h"
+
+#include <filesystem>
+#include <format>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace wallflow {
+
+struct CacheEntry {
+    std::string key;
+    std::shared_ptr<const DecodedImage> image;
+};
+
+std::list<CacheEntry> cache_entries;
+std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache_index;
+DecodedImageCacheStats cache_stats = {};
+
+std::mutex decoded_image_cache_mtx;
+
+std::string DecodedImageCacheStats::ToString()
+{
+    return std::format(
+        "DecodedImageCacheStats(hits={},misses={},evictions={},entries={},bytes={},budget={})",
+        hits,
+        misses,
+        evictions,
+        entries,
+        bytes,
+        budget);
+}
+
+size_t GetCacheBudget()
+{
+    return static_cast<size_t>(config->decodeCacheSize) * 1024 * 1024;
+}
+
+bool GetCacheKey(const std::string& path, uint16_t width, uint16_t height, const std::string& variant, std::string& key)
+{
+    std::error_code ec;
+    std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        WF_LOG(LogLevel::LWARNING, "could not read modification time of ({})", path);
+        return false;
+    }
+
+    key = std::format("{}|{}|{}x{}|{}", path, modified_at.time_since_epoch().count(), width, height, variant);
+    return true;
+}
+
+void EvictCachedImages(size_t budget)
+{
+    while (cache_stats.bytes > budget && !cache_entries.empty()) {
+        CacheEntry& entry = cache_entries.back();
+        WF_LOG(LogLevel::LINFO, "evicting decoded image ({})", entry.key);
+        cache_stats.bytes -= entry.image->pixels.size();
+        cache_stats.evictions++;
+        cache_index.erase(entry.key);
+        cache_entries.pop_back();
+    }
+    cache_stats.entries = cache_entries.size();
+}
+
+std::shared_ptr<const DecodedImage> GetCachedImage(const std::string& path, uint16_t width, uint16_t height, const std::string& variant)
+{
+    std::string key;
+    bool has_key = GetCacheKey(path, width, height, variant, key);
+
+    std::lock_guard<std::mutex> lock(decoded_image_cache_mtx);
+
+    if (!has_key) {
+        cache_stats.misses++;
+        return nullptr;
+    }
+
+    auto it = cache_index.find(key);
+    if (it == cache_index.end()) {
+        cache_stats.misses++;
+        return nullptr;
+    }
+
+    cache_entries.splice(cache_entries.begin(), cache_entries, it->second);
+    cache_stats.hits++;
+    return it->second->image;
+}
+
+void CacheImage(const std::string& path, uint16_t width, uint16_t height, const std::string& variant, std::shared_ptr<const DecodedImage> image)
+{
+    std::string key;
+    if (!GetCacheKey(path, width, height, variant, key)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(decoded_image_cache_mtx);
+
+    size_t budget = GetCacheBudget();
+    cache_stats.budget = budget;
+
+    if (image->pixels.size() > budget) {
+        WF_LOG(LogLevel::LINFO, "decoded image ({}) exceeds cache budget, not caching", path);
+        return;
+    }
+
+    auto it = cache_index.find(key);
+    if (it != cache_index.end()) {
+        cache_stats.bytes -= it->second->image->pixels.size();
+        cache_entries.erase(it->second);
+        cache_index.erase(it);
+    }
+
+    cache_entries.push_front({ key, image });
+    cache_index[key] = cache_entries.begin();
+    cache_stats.bytes += image->pixels.size();
+
+    EvictCachedImages(budget);
+}
+
+bool FitsDecodedImageCache(size_t size)
+{
+    return size <= GetCacheBudget();
+}
+
+void ClearDecodedImageCache()
+{
+    WF_LOG(LogLevel::LINFO, "clearing decoded image cache");
+
+    std::lock_guard<std::mutex> lock(decoded_image_cache_mtx);
+    cache_entries.clear();
+    cache_index.clear();
+    cache_stats.bytes = 0;
+    cache_stats.entries = 0;
+}
+
+DecodedImageCacheStats GetDecodedImageCacheStats()
+{
+    std::lock_guard<std::mutex> lock(decoded_image_cache_mtx);
+    DecodedImageCacheStats stats = cache_stats;
+    stats.budget = GetCacheBudget();
+    return stats;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "canvas.h"
+#include "log.h"
+#include "mem.h"
+#include "paths.h"
+
+#include <cstring>
+#include <format>
+
+namespace wallflow {
+
+// two canvases so the next cycle can be rendered while the current one is on screen
+Canvas canvases[2] = {};
+bool canvas_allocated[2] = { false, false };
+size_t front_canvas = 0;
+
+const size_t bmp_header_size = 54;
+
+std::string Canvas::ToString()
+{
+    return std::format(
+        "Canvas(bufferHandle={},mapped={},path={},width={},height={},stride={},regions={})",
+        bufferHandle,
+        mapped,
+        path,
+        size.width,
+        size.height,
+        stride,
+        regions.size());
+}
+
+Dimensions GetCanvasSize()
+{
+    uint16_t width = 0;
+    uint16_t height = 0;
+
+    for (Display display : displays) {
+        WF_LOG_OBJ(display);
+        uint16_t x = display.x + display.width;
+        uint16_t y = display.y + display.height;
+
+        if (x > width) {
+            width = x;
+        }
+        if (y > height) {
+            height = y;
+        }
+    }
+    WF_LOG(LogLevel::LINFO, "GetCanvasSize(width={},height={})", width, height);
+
+    return { width, height };
+}
+
+bool LayoutMatchesRegions(const Canvas& canvas, const std::vector<Display>& layout)
+{
+    for (const auto& pair : canvas.regions) {
+        const CanvasRegion& region = pair.second;
+        bool found = false;
+        for (const Display& display : layout) {
+            if (display.id == pair.first) {
+                found = region.x == display.x && region.y == display.y
+                    && region.width == display.width && region.height == display.height;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void WriteLE16(uint8_t* dst, uint16_t value)
+{
+    dst[0] = value & 0xFF;
+    dst[1] = (value >> 8) & 0xFF;
+}
+
+void WriteLE32(uint8_t* dst, uint32_t value)
+{
+    dst[0] = value & 0xFF;
+    dst[1] = (value >> 8) & 0xFF;
+    dst[2] = (value >> 16) & 0xFF;
+    dst[3] = (value >> 24) & 0xFF;
+}
+
+void WriteBMPHeader(uint8_t* header, Dimensions size, size_t stride)
+{
+    uint32_t pixels_size = static_cast<uint32_t>(stride * size.height);
+
+    memset(header, 0, bmp_header_size);
+    header[0] = 'B';
+    header[1] = 'M';
+    WriteLE32(header + 2, static_cast<uint32_t>(bmp_header_size + pixels_size));
+    WriteLE32(header + 10, static_cast<uint32_t>(bmp_header_size));
+    WriteLE32(header + 14, 40);
+    WriteLE32(header + 18, size.width);
+    WriteLE32(header + 22, size.height);
+    WriteLE16(header + 26, 1);
+    WriteLE16(header + 28, 24);
+    WriteLE32(header + 34, pixels_size);
+}
+
+void ReleaseCanvasSlot(size_t slot)
+{
+    if (!canvas_allocated[slot]) {
+        return;
+    }
+
+    WF_LOG(LogLevel::LINFO, "releasing canvas {}", slot);
+    ReleaseMemoryBuffer(canvases[slot].bufferHandle);
+    canvases[slot] = {};
+    canvas_allocated[slot] = false;
+}
+
+Canvas& AcquireCanvasSlot(size_t slot, Dimensions size, const std::vector<Display>& layout, bool mapped)
+{
+    Canvas& canvas = canvases[slot];
+
+    if (canvas_allocated[slot] && canvas.mapped == mapped && canvas.size.width == size.width && canvas.size.height == size.height) {
+        if (!LayoutMatchesRegions(canvas, layout)) {
+            // a display moved or went away, its old pixels would otherwise stay on the canvas
+            WF_LOG(LogLevel::LINFO, "display layout changed, clearing canvas");
+            memset(canvas.pixels, 0, canvas.stride * size.height);
+            canvas.regions.clear();
+        }
+        return canvas;
+    }
+
+    ReleaseCanvasSlot(slot);
+
+    WF_LOG(LogLevel::LINFO, "creating canvas {} width={},height={}", slot, size.width, size.height);
+    canvas.stride = (size.width * 3 + 3) & ~static_cast<size_t>(3);
+    canvas.path = GetAppDataPath(std::format("wallpaper_{}.bmp", slot));
+    canvas.mapped = mapped;
+
+    size_t buffer_size = bmp_header_size + canvas.stride * size.height;
+    if (mapped) {
+        canvas.bufferHandle = CreateFileMemoryBuffer(canvas.path, buffer_size);
+    } else {
+        canvas.bufferHandle = AcquireMemoryBuffer(buffer_size);
+    }
+    canvas.ptr = GetMemoryBuffer(canvas.bufferHandle).ptr;
+    canvas.pixels = canvas.ptr + bmp_header_size;
+    canvas.size = size;
+    canvas.regions.clear();
+    canvas_allocated[slot] = true;
+
+    // whatever the file held before is unknown, start from a clean canvas
+    WriteBMPHeader(canvas.ptr, size, canvas.stride);
+    memset(canvas.pixels, 0, canvas.stride * size.height);
+
+    return canvas;
+}
+
+Canvas& AcquireCanvas(Dimensions size, const std::vector<Display>& layout, bool mapped)
+{
+    return AcquireCanvasSlot(front_canvas, size, layout, mapped);
+}
+
+Canvas& AcquireBackCanvas(Dimensions size, const std::vector<Display>& layout, bool mapped)
+{
+    return AcquireCanvasSlot(1 - front_canvas, size, layout, mapped);
+}
+
+void SwapCanvases()
+{
+    front_canvas = 1 - front_canvas;
+    WF_LOG(LogLevel::LINFO, "canvas {} is now in front", front_canvas);
+}
+
+PixelView GetCanvasView(const Canvas& canvas, const Display& display)
+{
+    // rows are stored bottom-up, so walk upwards in memory from the display's top row
+    uint8_t* top_row = canvas.pixels + (canvas.size.height - 1 - display.y) * canvas.stride;
+    return { top_row + display.x * 3, -static_cast<ptrdiff_t>(canvas.stride), display.width, display.height };
+}
+
+bool IsRegionDirty(const Canvas& canvas, const Display& display, const std::string& image_path)
+{
+    auto it = canvas.regions.find(display.id);
+    if (it == canvas.regions.end()) {
+        return true;
+    }
+
+    const CanvasRegion& region = it->second;
+    return region.x != display.x
+        || region.y != display.y
+        || region.width != display.width
+        || region.height != display.height
+        || region.imagePath != image_path;
+}
+
+void MarkRegionDirty(Canvas& canvas, const Display& display)
+{
+    canvas.regions.erase(display.id);
+}
+
+void MarkRegionClean(Canvas& canvas, const Display& display, const std::string& image_path)
+{
+    canvas.regions[display.id] = { display.x, display.y, display.width, display.height, image_path };
+}
+
+void ReleaseCanvases()
+{
+    ReleaseCanvasSlot(0);
+    ReleaseCanvasSlot(1);
+    TrimMemoryBufferPool();
+}
+
+}
\ No newline at end of file
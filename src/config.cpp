@@ -2,6 +2,8 @@
 #include "config.h"
 #include "log.h"
 #include "paths.h"
+#include "scheduler.h"
+#include "trace.h"
 
 #include <chrono>
 #include <filesystem>
@@ -9,8 +11,11 @@
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <set>
+#include <unordered_map>
 
 #include <nlohmann/json.hpp>
+#include <sys/stat.h>
 
 namespace wallflow {
 
@@ -20,10 +25,26 @@ std::time_t last_modified_at;
 std::string Config::ToString()
 {
     return std::format(
-        "Config(wallpaperDir={},cycleSpeed={},shuffle={})",
+        "Config(wallpaperDir={},wallpaperDirs={},cycleSpeed={},cycleJitter={},shuffle={},decodeCacheSize={},derivativeCacheSize={},largePages={},preRenderLead={},repoRescanInterval={},metricsInterval={},imageFormat={},jpegQuality={},pngCompressionLevel={},pngFilter={},placement={},resampleFilter={},displayPlacement={},displayCycleSpeed={})",
         wallpaperDir,
+        wallpaperDirs.size(),
         cycleSpeed,
-        shuffle);
+        cycleJitter,
+        shuffle,
+        decodeCacheSize,
+        derivativeCacheSize,
+        largePages,
+        preRenderLead,
+        repoRescanInterval,
+        metricsInterval,
+        imageFormat,
+        jpegQuality,
+        pngCompressionLevel,
+        pngFilter,
+        placement,
+        resampleFilter,
+        displayPlacement.size(),
+        displayCycleSpeed.size());
 }
 
 std::string GetConfigPath()
@@ -49,7 +70,7 @@ void LoadConfig()
     std::lock_guard<std::mutex> lock(load_config_mtx);
 
     WF_LOG(LogLevel::LINFO, "loading config file");
-    WF_START_TIMER("LoadConfig()");
+    WF_TRACE_SCOPE("LoadConfig");
 
     std::string config_path = GetConfigPath();
 
@@ -70,12 +91,29 @@ void LoadConfig()
         config = new Config;
     }
     config->wallpaperDir = json_config["wallpaperDir"];
+    config->wallpaperDirs = json_config.value("wallpaperDirs", std::vector<std::string>());
     config->cycleSpeed = json_config["cycleSpeed"];
+    config->cycleJitter = json_config.value("cycleJitter", 0);
     config->shuffle = json_config["shuffle"];
+    config->decodeCacheSize = json_config.value("decodeCacheSize", 256);
+    config->derivativeCacheSize = json_config.value("derivativeCacheSize", 2048);
+    config->largePages = json_config.value("largePages", false);
+    config->preRenderLead = json_config.value("preRenderLead", 15);
+    config->repoRescanInterval = json_config.value("repoRescanInterval", 600);
+    // 0 writes the metrics on exit only
+    config->metricsInterval = json_config.value("metricsInterval", 0);
+    // bmp, png or jpg, raw is accepted by wallflow-render only and means bmp here
+    config->imageFormat = json_config.value("imageFormat", "bmp");
+    config->jpegQuality = json_config.value("jpegQuality", 95);
+    config->pngCompressionLevel = json_config.value("pngCompressionLevel", 1);
+    config->pngFilter = json_config.value("pngFilter", "sub");
+    config->placement = json_config.value("placement", "fill");
+    config->resampleFilter = json_config.value("resampleFilter", "lanczos3");
+    config->displayPlacement = json_config.value("displayPlacement", std::map<std::string, std::string>());
+    config->displayCycleSpeed = json_config.value("displayCycleSpeed", std::map<std::string, unsigned int>());
 
     last_modified_at = getConfigModifiedTime();
 
-    WF_END_TIMER("LoadConfig()");
     WF_LOG_OBJ_PTR(config);
 }
 
@@ -84,13 +122,12 @@ bool LoadConfigIfModified()
     std::lock_guard<std::mutex> lock(load_config_mtx);
 
     WF_LOG(LogLevel::LINFO, "loading config file if modified");
-    WF_START_TIMER("LoadConfigIfModified()");
+    WF_TRACE_SCOPE("LoadConfigIfModified");
 
     std::time_t modified_at = getConfigModifiedTime();
 
     if (modified_at == last_modified_at) {
         WF_LOG(LogLevel::LINFO, "config file has not been modified");
-        WF_END_TIMER("LoadConfigIfModified()");
         return false;
     }
 
@@ -98,44 +135,60 @@ bool LoadConfigIfModified()
 
     LoadConfig();
 
-    WF_END_TIMER("LoadConfigIfModified()");
 
     return true;
 };
 
 void CreateDefaultConfig()
 {
-    WF_LOG(LogLevel::LINFO, "creating default config file");
-    WF_START_TIMER("CreateDefaultConfig()");
-
-    nlohmann::json config_json;
-
     std::string wallpaper_path = SelectDirectoryDialog();
 
     if (wallpaper_path == "") {
         throw std::runtime_error("wallpaper directory must be selected");
     }
 
-    WF_LOG(LogLevel::LINFO, std::format("wallpaper directory selected ({})", wallpaper_path));
+    WF_LOG(LogLevel::LINFO, "wallpaper directory selected ({})", wallpaper_path);
+
+    CreateDefaultConfig(wallpaper_path);
+}
+
+void CreateDefaultConfig(const std::string& wallpaper_path)
+{
+    WF_LOG(LogLevel::LINFO, "creating default config file");
+    WF_TRACE_SCOPE("CreateDefaultConfig");
+
+    nlohmann::json config_json;
 
     config_json["wallpaperDir"] = wallpaper_path;
+    config_json["wallpaperDirs"] = nlohmann::json::array();
     config_json["cycleSpeed"] = 300;
+    config_json["cycleJitter"] = 0;
     config_json["shuffle"] = true;
-    config_json["imageFormat"] = "jpg";
+    config_json["decodeCacheSize"] = 256;
+    config_json["derivativeCacheSize"] = 2048;
+    config_json["largePages"] = false;
+    config_json["preRenderLead"] = 15;
+    config_json["repoRescanInterval"] = 600;
+    config_json["metricsInterval"] = 0;
+    // bmp composes straight into the mapped output file
+    config_json["imageFormat"] = "bmp";
     config_json["jpegQuality"] = 95;
+    config_json["pngCompressionLevel"] = 1;
+    config_json["pngFilter"] = "sub";
+    config_json["placement"] = "fill";
+    config_json["resampleFilter"] = "lanczos3";
+    config_json["displayPlacement"] = nlohmann::json::object();
+    config_json["displayCycleSpeed"] = nlohmann::json::object();
 
     std::string out_path = GetConfigPath();
     std::ofstream out_file(out_path);
 
     if (!out_file.is_open()) {
-        WF_END_TIMER("CreateDefaultConfig()");
         throw std::runtime_error("could not open config file to write defaults");
     }
 
     out_file << std::setw(4) << config_json << std::endl;
     out_file.close();
-
-    WF_END_TIMER("CreateDefaultConfig()");
 }
 
 std::mutex save_config_mtx;
@@ -145,30 +198,54 @@ void SaveConfig()
     std::lock_guard<std::mutex> lock(save_config_mtx);
 
     WF_LOG(LogLevel::LINFO, "saving config file");
-    WF_START_TIMER("SaveConfig()");
+    WF_TRACE_SCOPE("SaveConfig");
 
     nlohmann::json config_json;
 
     config_json["wallpaperDir"] = config->wallpaperDir;
+    config_json["wallpaperDirs"] = config->wallpaperDirs;
     config_json["cycleSpeed"] = config->cycleSpeed;
+    config_json["cycleJitter"] = config->cycleJitter;
     config_json["shuffle"] = config->shuffle;
+    config_json["decodeCacheSize"] = config->decodeCacheSize;
+    config_json["derivativeCacheSize"] = config->derivativeCacheSize;
+    config_json["largePages"] = config->largePages;
+    config_json["preRenderLead"] = config->preRenderLead;
+    config_json["repoRescanInterval"] = config->repoRescanInterval;
+    config_json["metricsInterval"] = config->metricsInterval;
+    config_json["imageFormat"] = config->imageFormat;
+    config_json["jpegQuality"] = config->jpegQuality;
+    config_json["pngCompressionLevel"] = config->pngCompressionLevel;
+    config_json["pngFilter"] = config->pngFilter;
+    config_json["placement"] = config->placement;
+    config_json["resampleFilter"] = config->resampleFilter;
+    config_json["displayPlacement"] = config->displayPlacement;
+    config_json["displayCycleSpeed"] = config->displayCycleSpeed;
 
     std::string out_path = GetConfigPath();
     std::ofstream out_file(out_path);
 
     if (!out_file.is_open()) {
-        WF_END_TIMER("SaveConfig()");
         throw std::runtime_error("could not open config file to write changes");
     }
 
     out_file << std::setw(4) << config_json << std::endl;
     out_file.close();
-
-    WF_END_TIMER("SaveConfig()");
 }
 
 std::mutex display_alias_mtx;
 
+// The alias file is read once and only read again when its modification time
+// moves. Changes are written behind by the scheduler, so the monitors of one
+// enumeration end up in a single write and the tray never waits on the disk.
+std::unordered_map<std::string, std::string> display_aliases;
+// ids changed since the last write, a reload keeps them
+std::set<std::string> display_alias_pending;
+std::filesystem::file_time_type display_aliases_modified_at;
+bool display_aliases_loaded = false;
+
+const std::chrono::seconds display_alias_write_delay(1);
+
 std::string GetDisplayAliasPath()
 {
     WF_LOG(LogLevel::LINFO, "retrieving display alias path");
@@ -195,15 +272,31 @@ void CreateDisplayAliasFileIfNotFound()
     out_file << std::setw(4) << alias_json << std::endl;
 }
 
-std::string GetDisplayAlias(std::string id)
+std::filesystem::file_time_type getDisplayAliasModifiedTime()
+{
+    std::error_code ec;
+    std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(GetDisplayAliasPath(), ec);
+    return ec ? std::filesystem::file_time_type::min() : modified_at;
+}
+
+// expects display_alias_mtx to be held
+void loadDisplayAliasesIfModified()
 {
-    WF_LOG(LogLevel::LINFO, std::format("retrieving display alias ({})", id));
+    // taken before reading, an edit racing the read is picked up next time
+    std::filesystem::file_time_type modified_at = getDisplayAliasModifiedTime();
+    if (display_aliases_loaded && modified_at == display_aliases_modified_at) {
+        return;
+    }
 
-    std::lock_guard<std::mutex> lock(display_alias_mtx);
-    CreateDisplayAliasFileIfNotFound();
+    WF_LOG(LogLevel::LINFO, "loading display alias file");
+    WF_TRACE_SCOPE("LoadDisplayAliases");
 
-    std::string in_path = GetDisplayAliasPath();
-    std::ifstream in_file(in_path);
+    if (modified_at == std::filesystem::file_time_type::min()) {
+        CreateDisplayAliasFileIfNotFound();
+        modified_at = getDisplayAliasModifiedTime();
+    }
+
+    std::ifstream in_file(GetDisplayAliasPath());
 
     if (!in_file.is_open()) {
         throw std::runtime_error("could not open display alias file to read");
@@ -211,8 +304,43 @@ std::string GetDisplayAlias(std::string id)
 
     nlohmann::json alias_json = nlohmann::json::parse(in_file);
 
-    if (alias_json[id].is_string()) {
-        return alias_json[id];
+    std::unordered_map<std::string, std::string> aliases;
+    if (alias_json.is_object()) {
+        for (const auto& [id, alias] : alias_json.items()) {
+            if (alias.is_string()) {
+                aliases[id] = alias;
+            }
+        }
+    }
+    for (const std::string& id : display_alias_pending) {
+        aliases[id] = display_aliases[id];
+    }
+
+    display_aliases = std::move(aliases);
+    display_aliases_modified_at = modified_at;
+    display_aliases_loaded = true;
+}
+
+// expects display_alias_mtx to be held
+void setDisplayAlias(const std::string& id, const std::string& alias)
+{
+    display_aliases[id] = alias;
+    display_alias_pending.insert(id);
+    ScheduleTimer("write_aliases", SchedulerClock::now() + display_alias_write_delay, FlushDisplayAliases);
+}
+
+std::string GetDisplayAlias(std::string id)
+{
+    WF_LOG(LogLevel::LINFO, "retrieving display alias ({})", id);
+
+    std::lock_guard<std::mutex> lock(display_alias_mtx);
+    if (!display_aliases_loaded) {
+        loadDisplayAliasesIfModified();
+    }
+
+    auto it = display_aliases.find(id);
+    if (it != display_aliases.end()) {
+        return it->second;
     }
 
     return "";
@@ -220,43 +348,98 @@ std::string GetDisplayAlias(std::string id)
 
 void SaveDisplayAlias(std::string id, std::string alias)
 {
-    WF_LOG(LogLevel::LINFO, std::format("saving display alias (id={},alias={})", id, alias));
+    WF_LOG(LogLevel::LINFO, "saving display alias (id={},alias={})", id, alias);
 
     std::lock_guard<std::mutex> lock(display_alias_mtx);
-    CreateDisplayAliasFileIfNotFound();
+    if (!display_aliases_loaded) {
+        loadDisplayAliasesIfModified();
+    }
 
-    std::string alias_path = GetDisplayAliasPath();
-    std::ifstream in_file(alias_path);
+    setDisplayAlias(id, alias);
+}
 
-    if (!in_file.is_open()) {
-        throw std::runtime_error("could not open display alias file to read");
-    }
+std::string GetOrCreateAlias(std::string id, std::string alias)
+{
+    WF_LOG(LogLevel::LINFO, "retrieving or creating alias for display (id={},alias={})", id, alias);
 
-    nlohmann::json alias_json = nlohmann::json::parse(in_file);
+    std::lock_guard<std::mutex> lock(display_alias_mtx);
+    loadDisplayAliasesIfModified();
 
-    alias_json[id] = alias;
+    auto it = display_aliases.find(id);
+    if (it != display_aliases.end() && it->second != "") {
+        return it->second;
+    }
 
-    std::ofstream out_file(alias_path);
+    WF_LOG(LogLevel::LINFO, "could not find alias for ({}) using default ({})", id, alias);
+    setDisplayAlias(id, alias);
+    return alias;
+}
 
-    if (!out_file.is_open()) {
-        throw std::runtime_error("could not open display aliases file to write");
+void RefreshDisplayAliases()
+{
+    std::lock_guard<std::mutex> lock(display_alias_mtx);
+
+    try {
+        loadDisplayAliasesIfModified();
+    } catch (const std::exception& ex) {
+        // most likely a file caught halfway through an edit, the aliases held stay
+        WF_LOG(LogLevel::LWARNING, "could not reload display aliases: {}", ex.what());
     }
+}
 
-    out_file << std::setw(4) << alias_json << std::endl;
+void RefreshDisplayAliasesLater()
+{
+    // a burst of requests replaces the pending one and costs a single check
+    ScheduleTimer("refresh_aliases", SchedulerClock::now(), RefreshDisplayAliases);
 }
 
-std::string GetOrCreateAlias(std::string id, std::string alias)
+void FlushDisplayAliases()
 {
-    WF_LOG(LogLevel::LINFO, std::format("retrieving or creating alias for display (id={},alias={})", id, alias));
+    std::lock_guard<std::mutex> lock(display_alias_mtx);
+
+    if (display_alias_pending.empty()) {
+        return;
+    }
 
-    std::string result = GetDisplayAlias(id);
-    if (result != "") {
-        WF_LOG(LogLevel::LINFO, std::format("could not find alias for ({}) using default ({})", id, alias));
-        return result;
+    WF_LOG(LogLevel::LINFO, "writing {} display alias changes", display_alias_pending.size());
+    WF_TRACE_SCOPE("FlushDisplayAliases");
+
+    try {
+        // edits made to the file in the meantime are merged rather than overwritten
+        loadDisplayAliasesIfModified();
+
+        nlohmann::json alias_json = nlohmann::json::object();
+        for (const auto& [id, alias] : display_aliases) {
+            alias_json[id] = alias;
+        }
+
+        // readers never see a half written file
+        std::string alias_path = GetDisplayAliasPath();
+        std::string tmp_path = alias_path + ".tmp";
+        {
+            std::ofstream out_file(tmp_path, std::ios::trunc);
+            if (!out_file.is_open()) {
+                throw std::runtime_error("could not open display aliases file to write");
+            }
+            out_file << std::setw(4) << alias_json << std::endl;
+            if (!out_file) {
+                throw std::runtime_error("could not write display aliases file");
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, alias_path, ec);
+        if (ec) {
+            throw std::runtime_error(std::format("could not replace display aliases file: {}", ec.message()));
+        }
+    } catch (const std::exception& ex) {
+        // the changes stay pending for the next write
+        WF_LOG(LogLevel::LWARNING, ex.what());
+        return;
     }
 
-    SaveDisplayAlias(id, alias);
-    return alias;
+    display_alias_pending.clear();
+    display_aliases_modified_at = getDisplayAliasModifiedTime();
 }
 
 void ChangeWallpaperDir()
@@ -273,7 +456,7 @@ void ChangeWallpaperDir()
     config->wallpaperDir = wallpaper_path;
     SaveConfig();
 
-    WF_LOG(LogLevel::LINFO, std::format("wallpaper directory changed to ({})", config->wallpaperDir));
+    WF_LOG(LogLevel::LINFO, "wallpaper directory changed to ({})", config->wallpaperDir);
 }
 
 void ToggleShuffle()
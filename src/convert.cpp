@@ -1,6 +1,7 @@
 #include "convert.h"
 
 #include <codecvt>
+#include <locale>
 
 std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_converter;
 
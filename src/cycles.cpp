@@ -0,0 +1,166 @@
+#include "cycles.h"
+#include "config.h"
+#include "log.h"
+#include "scheduler.h"
+#include "wallpapers.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace wallflow {
+
+struct DisplayCycle {
+    SchedulerClock::time_point lastAt;
+    SchedulerClock::duration jitter;
+};
+
+// displays due within this window of each other are composed in one cycle
+const std::chrono::seconds cycle_coalesce_window(1);
+
+// by display id, only touched on the scheduler thread
+std::map<std::string, DisplayCycle> display_cycles;
+bool cycle_prepared = false;
+
+std::chrono::seconds GetDisplayCycleInterval(const Display& display)
+{
+    auto it = config->displayCycleSpeed.find(display.alias);
+    unsigned int speed = it != config->displayCycleSpeed.end() ? it->second : config->cycleSpeed;
+    return std::chrono::seconds(std::max(speed, 1u));
+}
+
+SchedulerClock::duration GetCycleJitter()
+{
+    if (config->cycleJitter == 0) {
+        return SchedulerClock::duration::zero();
+    }
+
+    static std::mt19937 rng(std::random_device {}());
+    int64_t jitter_ms = static_cast<int64_t>(config->cycleJitter) * 1000;
+    std::uniform_int_distribution<int64_t> distribution(-jitter_ms, jitter_ms);
+    return std::chrono::milliseconds(distribution(rng));
+}
+
+SchedulerClock::time_point GetDisplayCycleDue(const Display& display, const DisplayCycle& cycle)
+{
+    // jitter never brings two cycles of a display closer than a second
+    SchedulerClock::duration interval = GetDisplayCycleInterval(display) + cycle.jitter;
+    return cycle.lastAt + std::max<SchedulerClock::duration>(interval, std::chrono::seconds(1));
+}
+
+void ScheduleNextCycle();
+
+void PrepareNextCycle()
+{
+    WF_LOG(LogLevel::LINFO, "preparing next wallpaper cycle");
+
+    // a failed preparation is not retried, the cycle composes from scratch instead
+    cycle_prepared = true;
+    try {
+        PrepareCycleAllDisplays();
+    } catch (const std::exception& ex) {
+        WF_LOG(LogLevel::LERROR, ex.what());
+    }
+}
+
+void RunDueCycles()
+{
+    auto now = SchedulerClock::now();
+    std::vector<Display> due_displays;
+
+    for (const Display& display : displays) {
+        auto it = display_cycles.find(display.id);
+        if (it != display_cycles.end() && GetDisplayCycleDue(display, it->second) <= now + cycle_coalesce_window) {
+            due_displays.push_back(display);
+        }
+    }
+
+    try {
+        if (!due_displays.empty() && due_displays.size() == displays.size()) {
+            WF_LOG(LogLevel::LINFO, "scheduled wallpaper cycle");
+            if (!CommitPreparedCycle()) {
+                CycleAllDisplays();
+            }
+        } else if (!due_displays.empty()) {
+            WF_LOG(LogLevel::LINFO, "scheduled wallpaper cycle of {} displays", due_displays.size());
+            CycleDisplays(due_displays);
+        }
+    } catch (const std::exception& ex) {
+        WF_LOG(LogLevel::LERROR, ex.what());
+    }
+
+    // displays cycled together share the jitter, so they stay in step
+    SchedulerClock::duration jitter = GetCycleJitter();
+    for (const Display& display : due_displays) {
+        display_cycles[display.id] = { now, jitter };
+    }
+    cycle_prepared = false;
+
+    ScheduleNextCycle();
+}
+
+void ScheduleNextCycle()
+{
+    auto now = SchedulerClock::now();
+
+    // displays that appeared since were just drawn by whatever loaded them
+    std::map<std::string, DisplayCycle> cycles;
+    for (const Display& display : displays) {
+        auto it = display_cycles.find(display.id);
+        cycles[display.id] = it != display_cycles.end() ? it->second : DisplayCycle { now, SchedulerClock::duration::zero() };
+    }
+    display_cycles = std::move(cycles);
+
+    if (displays.empty()) {
+        CancelTimer("cycle");
+        CancelTimer("prepare");
+        return;
+    }
+
+    SchedulerClock::time_point first = SchedulerClock::time_point::max();
+    SchedulerClock::time_point last = SchedulerClock::time_point::min();
+    for (const Display& display : displays) {
+        SchedulerClock::time_point due = GetDisplayCycleDue(display, display_cycles[display.id]);
+        first = std::min(first, due);
+        last = std::max(last, due);
+    }
+
+    ScheduleTimer("cycle", first, RunDueCycles);
+
+    // only a cycle of every display can be prepared ahead
+    std::chrono::seconds lead(std::min(config->preRenderLead, config->cycleSpeed));
+    if (!cycle_prepared && lead.count() > 0 && last - first <= cycle_coalesce_window) {
+        ScheduleTimer("prepare", first - lead, PrepareNextCycle);
+    } else {
+        CancelTimer("prepare");
+    }
+
+    WF_LOG(LogLevel::LINFO, "next wallpaper cycle in {}s", std::chrono::duration_cast<std::chrono::seconds>(first - now).count());
+}
+
+void StartWallpaperCycles()
+{
+    StartScheduler();
+    PostSchedulerTask([] {
+        auto now = SchedulerClock::now();
+        display_cycles.clear();
+        for (const Display& display : displays) {
+            display_cycles[display.id] = { now - GetDisplayCycleInterval(display), SchedulerClock::duration::zero() };
+        }
+        ScheduleNextCycle();
+    });
+}
+
+void RescheduleWallpaperCycles()
+{
+    PostSchedulerTask(ScheduleNextCycle);
+}
+
+void StopWallpaperCycles()
+{
+    StopScheduler();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,513 @@
+#include "derivatives.h"
+#include "config.h"
+#include "log.h"
+#include "paths.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace wallflow {
+
+const char derivative_magic[4] = { 'W', 'F', 'D', '1' };
+const uint32_t derivative_version = 1;
+
+// bytes hashed from each end of a source, enough to tell edited or replaced
+// files apart without reading whole images on every lookup
+const size_t derivative_sample_size = 64 * 1024;
+
+const uint64_t fnv_offset_basis = 0xcbf29ce484222325ULL;
+const uint64_t fnv_prime = 0x100000001b3ULL;
+
+// A derivative file is this header followed by tightly packed top-down BGR
+// rows, exactly what a DecodedImage holds.
+struct DerivativeHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t contentHash;
+    int64_t modifiedAt;
+    uint64_t variantHash;
+    uint16_t width;
+    uint16_t height;
+    uint32_t reserved;
+    uint64_t pixelsSize;
+};
+
+struct DerivativeKey {
+    uint64_t contentHash;
+    int64_t modifiedAt;
+    uint64_t variantHash;
+    uint16_t width;
+    uint16_t height;
+    std::string fileName;
+};
+
+struct ContentHashEntry {
+    int64_t modifiedAt;
+    uintmax_t size;
+    uint64_t hash;
+};
+
+struct DerivativeFile {
+    size_t size;
+    std::filesystem::file_time_type lastUsed;
+};
+
+std::map<std::string, ContentHashEntry> content_hashes;
+std::map<std::string, DerivativeFile> derivative_files;
+bool derivative_index_loaded = false;
+DerivativeCacheStats derivative_stats = {};
+
+std::mutex derivative_cache_mtx;
+
+std::string DerivativeCacheStats::ToString()
+{
+    return std::format(
+        "DerivativeCacheStats(hits={},misses={},writes={},evictions={},files={},bytes={},budget={})",
+        hits,
+        misses,
+        writes,
+        evictions,
+        files,
+        bytes,
+        budget);
+}
+
+std::string GetDerivativeCacheDir()
+{
+    return GetAppDataPath("derivatives");
+}
+
+std::string GetDerivativePath(const std::string& file_name)
+{
+    return (std::filesystem::path(GetDerivativeCacheDir()) / file_name).string();
+}
+
+size_t GetDerivativeCacheBudget()
+{
+    return static_cast<size_t>(config->derivativeCacheSize) * 1024 * 1024;
+}
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+bool HashFileContent(const std::string& path, uintmax_t size, uint64_t& hash)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<char> sample(static_cast<size_t>(std::min<uintmax_t>(size, derivative_sample_size)));
+
+    hash = HashBytes(fnv_offset_basis, &size, sizeof(size));
+
+    file.read(sample.data(), sample.size());
+    if (!file) {
+        return false;
+    }
+    hash = HashBytes(hash, sample.data(), sample.size());
+
+    if (size > derivative_sample_size) {
+        file.seekg(static_cast<std::streamoff>(size - sample.size()));
+        file.read(sample.data(), sample.size());
+        if (!file) {
+            return false;
+        }
+        hash = HashBytes(hash, sample.data(), sample.size());
+    }
+    return true;
+}
+
+bool GetDerivativeKey(const std::string& path, uint16_t width, uint16_t height, const std::string& variant, DerivativeKey& key)
+{
+    std::error_code ec;
+    std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+
+    key.modifiedAt = modified_at.time_since_epoch().count();
+    key.width = width;
+    key.height = height;
+    key.variantHash = HashBytes(fnv_offset_basis, variant.data(), variant.size());
+
+    bool known = false;
+    {
+        std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+        auto it = content_hashes.find(path);
+        if (it != content_hashes.end() && it->second.modifiedAt == key.modifiedAt && it->second.size == size) {
+            key.contentHash = it->second.hash;
+            known = true;
+        }
+    }
+
+    if (!known) {
+        if (!HashFileContent(path, size, key.contentHash)) {
+            WF_LOG(LogLevel::LWARNING, "could not hash content of ({})", path);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+        content_hashes[path] = { key.modifiedAt, size, key.contentHash };
+    }
+
+    uint64_t hash = HashBytes(fnv_offset_basis, &key.contentHash, sizeof(key.contentHash));
+    hash = HashBytes(hash, &key.modifiedAt, sizeof(key.modifiedAt));
+    hash = HashBytes(hash, &key.variantHash, sizeof(key.variantHash));
+    hash = HashBytes(hash, &key.width, sizeof(key.width));
+    hash = HashBytes(hash, &key.height, sizeof(key.height));
+    key.fileName = std::format("{:016x}.wfd", hash);
+    return true;
+}
+
+// expects derivative_cache_mtx to be held
+void LoadDerivativeIndex()
+{
+    if (derivative_index_loaded) {
+        return;
+    }
+    derivative_index_loaded = true;
+
+    std::string dir = GetDerivativeCacheDir();
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        WF_LOG(LogLevel::LWARNING, "could not create derivative cache directory ({})", dir);
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        if (entry.path().extension() == ".tmp") {
+            // left behind by a write that never finished
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+        if (entry.path().extension() == ".wfd") {
+            DerivativeFile file = { static_cast<size_t>(entry.file_size()), entry.last_write_time() };
+            derivative_files[entry.path().filename().string()] = file;
+            derivative_stats.bytes += file.size;
+        }
+    }
+    derivative_stats.files = derivative_files.size();
+
+    WF_LOG(LogLevel::LINFO, "indexed {} derivatives ({} bytes)", derivative_stats.files, derivative_stats.bytes);
+}
+
+// expects derivative_cache_mtx to be held
+void RemoveDerivative(const std::string& file_name)
+{
+    auto it = derivative_files.find(file_name);
+    if (it == derivative_files.end()) {
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(GetDerivativePath(file_name), ec);
+    derivative_stats.bytes -= it->second.size;
+    derivative_files.erase(it);
+    derivative_stats.files = derivative_files.size();
+}
+
+// expects derivative_cache_mtx to be held
+void EvictDerivatives(size_t budget)
+{
+    while (derivative_stats.bytes > budget && !derivative_files.empty()) {
+        auto oldest = derivative_files.begin();
+        for (auto it = derivative_files.begin(); it != derivative_files.end(); it++) {
+            if (it->second.lastUsed < oldest->second.lastUsed) {
+                oldest = it;
+            }
+        }
+
+        WF_LOG(LogLevel::LINFO, "evicting derivative ({})", oldest->first);
+        RemoveDerivative(oldest->first);
+        derivative_stats.evictions++;
+    }
+}
+
+struct MappedDerivativeFile {
+    const uint8_t* view;
+    uint64_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+bool MapDerivativeFile(const std::string& file_path, MappedDerivativeFile& mapped)
+{
+    mapped.file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(mapped.file, &file_size) || static_cast<uint64_t>(file_size.QuadPart) < sizeof(DerivativeHeader)) {
+        CloseHandle(mapped.file);
+        return false;
+    }
+    mapped.size = static_cast<uint64_t>(file_size.QuadPart);
+
+    mapped.mapping = CreateFileMappingA(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped.mapping == NULL) {
+        CloseHandle(mapped.file);
+        return false;
+    }
+
+    mapped.view = reinterpret_cast<const uint8_t*>(MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0));
+    if (mapped.view == NULL) {
+        CloseHandle(mapped.mapping);
+        CloseHandle(mapped.file);
+        return false;
+    }
+    return true;
+}
+
+void UnmapDerivativeFile(MappedDerivativeFile& mapped)
+{
+    UnmapViewOfFile(mapped.view);
+    CloseHandle(mapped.mapping);
+    CloseHandle(mapped.file);
+}
+
+#else
+
+bool MapDerivativeFile(const std::string& file_path, MappedDerivativeFile& mapped)
+{
+    mapped.fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (mapped.fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(mapped.fd, &file_stat) != 0 || static_cast<uint64_t>(file_stat.st_size) < sizeof(DerivativeHeader)) {
+        close(mapped.fd);
+        return false;
+    }
+    mapped.size = static_cast<uint64_t>(file_stat.st_size);
+
+    void* view = mmap(NULL, mapped.size, PROT_READ, MAP_PRIVATE, mapped.fd, 0);
+    if (view == MAP_FAILED) {
+        close(mapped.fd);
+        return false;
+    }
+    // read once front to back
+    madvise(view, mapped.size, MADV_SEQUENTIAL);
+    mapped.view = static_cast<const uint8_t*>(view);
+    return true;
+}
+
+void UnmapDerivativeFile(MappedDerivativeFile& mapped)
+{
+    munmap(const_cast<uint8_t*>(mapped.view), mapped.size);
+    close(mapped.fd);
+}
+
+#endif
+
+bool ReadDerivativeFile(const std::string& file_path, const DerivativeKey& key, PixelView view)
+{
+    MappedDerivativeFile mapped;
+    if (!MapDerivativeFile(file_path, mapped)) {
+        return false;
+    }
+
+    DerivativeHeader header;
+    memcpy(&header, mapped.view, sizeof(header));
+
+    size_t row_size = static_cast<size_t>(key.width) * 3;
+    size_t pixels_size = row_size * key.height;
+
+    bool valid = memcmp(header.magic, derivative_magic, sizeof(derivative_magic)) == 0
+        && header.version == derivative_version
+        && header.contentHash == key.contentHash
+        && header.modifiedAt == key.modifiedAt
+        && header.variantHash == key.variantHash
+        && header.width == key.width
+        && header.height == key.height
+        && header.pixelsSize == pixels_size
+        && mapped.size == sizeof(header) + pixels_size;
+
+    // the mapping is copied into the canvas row by row, nothing in between
+    if (valid) {
+        const uint8_t* pixels = mapped.view + sizeof(header);
+        for (int y = 0; y < view.height; y++) {
+            memcpy(view.data + y * view.stride, pixels + y * row_size, row_size);
+        }
+    }
+
+    UnmapDerivativeFile(mapped);
+    return valid;
+}
+
+bool LoadDerivative(const std::string& path, const std::string& variant, PixelView view)
+{
+    WF_TRACE_SCOPE("LoadDerivative");
+    if (GetDerivativeCacheBudget() == 0) {
+        return false;
+    }
+
+    DerivativeKey key;
+    if (!GetDerivativeKey(path, view.width, view.height, variant, key)) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+        LoadDerivativeIndex();
+        if (derivative_files.find(key.fileName) == derivative_files.end()) {
+            derivative_stats.misses++;
+            return false;
+        }
+    }
+
+    std::string file_path = GetDerivativePath(key.fileName);
+    bool loaded = ReadDerivativeFile(file_path, key, view);
+
+    std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+
+    if (!loaded) {
+        WF_LOG(LogLevel::LWARNING, "discarding unreadable derivative ({}) of ({})", key.fileName, path);
+        RemoveDerivative(key.fileName);
+        derivative_stats.misses++;
+        return false;
+    }
+
+    // the write time doubles as the last use so eviction order survives restarts
+    std::filesystem::file_time_type now = std::filesystem::file_time_type::clock::now();
+    std::error_code ec;
+    std::filesystem::last_write_time(file_path, now, ec);
+
+    auto it = derivative_files.find(key.fileName);
+    if (it != derivative_files.end()) {
+        it->second.lastUsed = now;
+    }
+    derivative_stats.hits++;
+
+    WF_LOG(LogLevel::LINFO, "loaded derivative ({}) of ({})", key.fileName, path);
+    return true;
+}
+
+void StoreDerivative(const std::string& path, const std::string& variant, PixelView view)
+{
+    WF_TRACE_SCOPE("StoreDerivative");
+    size_t budget = GetDerivativeCacheBudget();
+    size_t row_size = static_cast<size_t>(view.width) * 3;
+    size_t pixels_size = row_size * view.height;
+    size_t file_size = sizeof(DerivativeHeader) + pixels_size;
+    if (file_size > budget) {
+        return;
+    }
+
+    DerivativeKey key;
+    if (!GetDerivativeKey(path, view.width, view.height, variant, key)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+        LoadDerivativeIndex();
+        if (derivative_files.find(key.fileName) != derivative_files.end()) {
+            return;
+        }
+    }
+
+    DerivativeHeader header = {};
+    memcpy(header.magic, derivative_magic, sizeof(derivative_magic));
+    header.version = derivative_version;
+    header.contentHash = key.contentHash;
+    header.modifiedAt = key.modifiedAt;
+    header.variantHash = key.variantHash;
+    header.width = view.width;
+    header.height = view.height;
+    header.pixelsSize = pixels_size;
+
+    // written under a temporary name and renamed, readers never see a partial file
+    std::string file_path = GetDerivativePath(key.fileName);
+    std::string temp_path = std::format("{}.{:x}.tmp", file_path, std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::error_code ec;
+
+    {
+        std::ofstream out_file(temp_path, std::ios::binary | std::ios::trunc);
+        if (out_file.is_open()) {
+            out_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            // rows go out top-down and unpadded whatever the stride of the view
+            for (int y = 0; y < view.height; y++) {
+                out_file.write(reinterpret_cast<const char*>(view.data + y * view.stride), row_size);
+            }
+        }
+        if (!out_file.is_open() || !out_file) {
+            out_file.close();
+            std::filesystem::remove(temp_path, ec);
+            WF_LOG(LogLevel::LWARNING, "could not write derivative of ({})", path);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temp_path, file_path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        WF_LOG(LogLevel::LWARNING, "could not store derivative of ({})", path);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+
+    if (derivative_files.find(key.fileName) == derivative_files.end()) {
+        derivative_files[key.fileName] = { file_size, std::filesystem::file_time_type::clock::now() };
+        derivative_stats.bytes += file_size;
+        derivative_stats.files = derivative_files.size();
+    }
+    derivative_stats.writes++;
+
+    WF_LOG(LogLevel::LINFO, "stored derivative ({}) of ({})", key.fileName, path);
+    EvictDerivatives(budget);
+}
+
+DerivativeCacheStats GetDerivativeCacheStats()
+{
+    std::lock_guard<std::mutex> lock(derivative_cache_mtx);
+    DerivativeCacheStats stats = derivative_stats;
+    stats.budget = GetDerivativeCacheBudget();
+    return stats;
+}
+
+}
\ No newline at end of file
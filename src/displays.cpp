@@ -1,18 +1,19 @@
 #include "displays.h"
-#include "config.h"
-#include "convert.h"
 #include "log.h"
-#include "paths.h"
+#include "platform.h"
+#include "trace.h"
 
+#include <atomic>
 #include <format>
 #include <fstream>
-
-#include <windows.h>
+#include <mutex>
+#include <stdexcept>
 
 namespace wallflow {
 
 std::vector<Display> displays;
 std::vector<Display> tmp_displays;
+std::atomic<uint64_t> display_generation = 0;
 
 std::string Display::ToString()
 {
@@ -26,39 +27,6 @@ std::string Display::ToString()
         height);
 }
 
-BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
-{
-    MONITORINFOEX monitor_info;
-    monitor_info.cbSize = sizeof(MONITORINFOEX);
-
-    if (GetMonitorInfo(hMonitor, &monitor_info)) {
-
-        Display display;
-
-        std::wstring wid;
-        for (int i = 0; i < 32 && monitor_info.szDevice[i] != L'\0'; ++i) {
-            wid += monitor_info.szDevice[i];
-        }
-
-        RECT rect = monitor_info.rcMonitor;
-
-        display.x = rect.left;
-        display.y = rect.top;
-
-        display.width = rect.right - rect.left;
-        display.height = rect.bottom - rect.top;
-
-        std::string repo_key = std::format("{}x{}", display.width, display.height);
-        display.id = std::format("{}:{}", WStringToString(wid), repo_key);
-        display.repoKey = repo_key;
-        display.alias = GetOrCreateAlias(display.id, repo_key);
-
-        tmp_displays.push_back(display);
-    }
-
-    return TRUE;
-}
-
 void correctDisplayOffsetsAndStore()
 {
     int min_x = 0;
@@ -80,6 +48,11 @@ void correctDisplayOffsetsAndStore()
     }
 }
 
+uint64_t GetDisplayGeneration()
+{
+    return display_generation;
+}
+
 std::mutex load_monitors_mtx;
 
 void LoadDisplays()
@@ -88,19 +61,18 @@ void LoadDisplays()
 
     tmp_displays.clear();
 
-    WF_START_TIMER("LoadDisplays()");
-    if (!EnumDisplayMonitors(NULL, NULL, MonitorEnumProc, 0)) {
+    WF_TRACE_SCOPE("LoadDisplays");
+    if (!GetDisplaySource().Enumerate(tmp_displays)) {
         throw std::runtime_error("failed to get displays");
     }
 
     displays.clear();
     correctDisplayOffsetsAndStore();
+    display_generation++;
 
     for (Display display : displays) {
         WF_LOG_OBJ(display);
     }
-
-    WF_END_TIMER("LoadDisplays()");
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include "encoders.h"
+#include "config.h"
+#include "kernels.h"
+#include "log.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <vector>
+
+#include <jpeglib.h>
+#include <png.h>
+
+namespace wallflow {
+
+std::string EncodeResult::ToString()
+{
+    return std::format(
+        "EncodeResult(path={},bytesWritten={},elapsed={}us)",
+        path,
+        bytesWritten,
+        elapsed.count());
+}
+
+std::string GetOutputPath(const Canvas& canvas, const char* extension)
+{
+    return std::filesystem::path(canvas.path).replace_extension(extension).string();
+}
+
+uint8_t* GetCanvasRow(const Canvas& canvas, uint16_t y)
+{
+    return canvas.pixels + (canvas.size.height - 1 - y) * canvas.stride;
+}
+
+class BMPEncoder : public OutputEncoder {
+public:
+    const char* Name() const override { return "bmp"; }
+    const char* Extension() const override { return ".bmp"; }
+    bool EncodesInPlace() const override { return true; }
+
+    EncodeResult Encode(const Canvas& canvas) override
+    {
+        // the canvas is the mapped BMP file, the dirty pages are written back by the OS
+        return { canvas.path, canvas.stride * canvas.size.height + (canvas.pixels - canvas.ptr), std::chrono::microseconds(0) };
+    }
+};
+
+class PNGEncoder : public OutputEncoder {
+public:
+    PNGEncoder(int compression_level, int filters)
+        : compressionLevel(compression_level)
+        , filters(filters)
+    {
+    }
+
+    const char* Name() const override { return "png"; }
+    const char* Extension() const override { return ".png"; }
+
+    EncodeResult Encode(const Canvas& canvas) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string path = GetOutputPath(canvas, Extension());
+
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp) {
+            throw std::runtime_error("error opening PNG file for writing");
+        }
+
+        png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        if (!png) {
+            fclose(fp);
+            throw std::runtime_error("error initializing libpng for writing");
+        }
+
+        png_infop info = png_create_info_struct(png);
+        if (!info) {
+            fclose(fp);
+            png_destroy_write_struct(&png, NULL);
+            throw std::runtime_error("error creating PNG info struct");
+        }
+
+        if (rows.size() < canvas.size.height) {
+            rows.resize(canvas.size.height);
+        }
+
+        if (setjmp(png_jmpbuf(png))) {
+            fclose(fp);
+            png_destroy_write_struct(&png, &info);
+            throw std::runtime_error("error during PNG file write");
+        }
+
+        png_init_io(png, fp);
+        png_set_compression_level(png, compressionLevel);
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, filters);
+
+        png_set_IHDR(png, info, canvas.size.width, canvas.size.height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+        png_set_bgr(png);
+
+        // walk the bottom-up canvas rows top-down instead of flipping the pixels
+        for (uint16_t y = 0; y < canvas.size.height; y++) {
+            rows[y] = GetCanvasRow(canvas, y);
+        }
+
+        png_write_image(png, rows.data());
+        png_write_end(png, info);
+        png_destroy_write_struct(&png, &info);
+
+        size_t bytes_written = ftell(fp);
+        fclose(fp);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        return { path, bytes_written, elapsed };
+    }
+
+private:
+    int compressionLevel;
+    int filters;
+    std::vector<png_bytep> rows;
+};
+
+struct JPEGEncoderErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void JPEGEncoderErrorExit(j_common_ptr cinfo)
+{
+    JPEGEncoderErrorManager* err = reinterpret_cast<JPEGEncoderErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    longjmp(err->jump, 1);
+}
+
+class JPEGEncoder : public OutputEncoder {
+public:
+    JPEGEncoder(int quality)
+        : quality(quality)
+    {
+    }
+
+    const char* Name() const override { return "jpg"; }
+    const char* Extension() const override { return ".jpg"; }
+
+    EncodeResult Encode(const Canvas& canvas) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string path = GetOutputPath(canvas, Extension());
+
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp) {
+            throw std::runtime_error("error opening JPEG file for writing");
+        }
+
+        jpeg_compress_struct cinfo;
+        JPEGEncoderErrorManager jerr;
+        cinfo.err = jpeg_std_error(&jerr.pub);
+        jerr.pub.error_exit = JPEGEncoderErrorExit;
+        jerr.message[0] = '\0';
+
+        if (setjmp(jerr.jump)) {
+            jpeg_destroy_compress(&cinfo);
+            fclose(fp);
+            throw std::runtime_error(std::format("error during JPEG file write: {}", jerr.message));
+        }
+
+        jpeg_create_compress(&cinfo);
+        jpeg_stdio_dest(&cinfo, fp);
+
+        // libjpeg-turbo takes the BGR canvas rows as they are
+        cinfo.image_width = canvas.size.width;
+        cinfo.image_height = canvas.size.height;
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_EXT_BGR;
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, quality, TRUE);
+        cinfo.dct_method = JDCT_ISLOW;
+
+        jpeg_start_compress(&cinfo, TRUE);
+
+        while (cinfo.next_scanline < cinfo.image_height) {
+            JSAMPROW row = GetCanvasRow(canvas, cinfo.next_scanline);
+            jpeg_write_scanlines(&cinfo, &row, 1);
+        }
+
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+
+        size_t bytes_written = ftell(fp);
+        fclose(fp);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        return { path, bytes_written, elapsed };
+    }
+
+private:
+    int quality;
+};
+
+// Headerless top-down BGRX rows, meant for consumers that upload straight to
+// a texture. The wallpaper engine cannot read it, so only wallflow-render
+// writes it, the tray app falls back to bmp when imageFormat asks for raw.
+class RawBGRXEncoder : public OutputEncoder {
+public:
+    const char* Name() const override { return "raw"; }
+    const char* Extension() const override { return ".bgrx"; }
+    bool IsDisplayable() const override { return false; }
+
+    EncodeResult Encode(const Canvas& canvas) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string path = GetOutputPath(canvas, Extension());
+
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp) {
+            throw std::runtime_error("error opening raw file for writing");
+        }
+
+        const PixelKernels& kernels = GetPixelKernels();
+        row.resize(canvas.size.width * 4);
+
+        size_t bytes_written = 0;
+        for (uint16_t y = 0; y < canvas.size.height; y++) {
+            kernels.bgrToBgrx(GetCanvasRow(canvas, y), row.data(), canvas.size.width);
+            bytes_written += fwrite(row.data(), 1, row.size(), fp);
+        }
+
+        fclose(fp);
+
+        if (bytes_written != row.size() * canvas.size.height) {
+            throw std::runtime_error("error during raw file write");
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        return { path, bytes_written, elapsed };
+    }
+
+private:
+    std::vector<uint8_t> row;
+};
+
+int GetPNGFilters(const std::string& filter)
+{
+    if (filter == "none") {
+        return PNG_FILTER_NONE;
+    }
+    if (filter == "sub") {
+        return PNG_FILTER_SUB;
+    }
+    if (filter == "up") {
+        return PNG_FILTER_UP;
+    }
+    if (filter == "avg") {
+        return PNG_FILTER_AVG;
+    }
+    if (filter == "paeth") {
+        return PNG_FILTER_PAETH;
+    }
+    if (filter == "all") {
+        return PNG_ALL_FILTERS;
+    }
+
+    WF_LOG(LogLevel::LWARNING, "unknown PNG filter ({}), using sub", filter);
+    return PNG_FILTER_SUB;
+}
+
+std::unique_ptr<OutputEncoder> CreateOutputEncoder(const std::string& format, int jpeg_quality, int png_compression_level, const std::string& png_filter)
+{
+    if (format == "bmp") {
+        return std::make_unique<BMPEncoder>();
+    }
+    if (format == "png") {
+        return std::make_unique<PNGEncoder>(png_compression_level, GetPNGFilters(png_filter));
+    }
+    if (format == "jpg" || format == "jpeg") {
+        return std::make_unique<JPEGEncoder>(jpeg_quality);
+    }
+    if (format == "raw") {
+        return std::make_unique<RawBGRXEncoder>();
+    }
+
+    throw std::runtime_error(std::format("unsupported output image format ({})", format));
+}
+
+std::unique_ptr<OutputEncoder> output_encoder;
+std::string output_encoder_settings;
+std::mutex output_encoder_mtx;
+
+OutputEncoder& GetOutputEncoder()
+{
+    std::lock_guard<std::mutex> lock(output_encoder_mtx);
+
+    std::string settings = std::format("{}|{}|{}|{}", config->imageFormat, config->jpegQuality, config->pngCompressionLevel, config->pngFilter);
+    if (output_encoder && settings == output_encoder_settings) {
+        return *output_encoder;
+    }
+
+    WF_LOG(LogLevel::LINFO, "creating output encoder ({})", settings);
+
+    try {
+        output_encoder = CreateOutputEncoder(config->imageFormat, config->jpegQuality, config->pngCompressionLevel, config->pngFilter);
+    } catch (const std::exception& ex) {
+        WF_LOG(LogLevel::LWARNING, "{}, falling back to bmp", ex.what());
+        output_encoder = std::make_unique<BMPEncoder>();
+    }
+
+    if (!output_encoder->IsDisplayable()) {
+        WF_LOG(LogLevel::LWARNING, "output format {} is only for wallflow-render and cannot be used as a wallpaper, falling back to bmp", output_encoder->Name());
+        output_encoder = std::make_unique<BMPEncoder>();
+    }
+
+    output_encoder_settings = settings;
+    return *output_encoder;
+}
+
+}
\ No newline at end of file
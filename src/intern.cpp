@@ -0,0 +1,243 @@
+#include "intern.h"
+#include "log.h"
+
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace wallflow {
+
+struct InternedPath {
+    uint32_t dir;
+    uint32_t nameSize;
+    const char* name;
+};
+
+struct InternedDirHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view dir) const
+    {
+        return std::hash<std::string_view>()(dir);
+    }
+};
+
+// names are packed into blocks that never move, so the views into them stay valid
+const size_t path_arena_block_size = 64 * 1024;
+
+std::vector<std::unique_ptr<char[]>> path_arena_blocks;
+size_t path_arena_block_used = path_arena_block_size;
+size_t path_arena_bytes = 0;
+
+// every image in a folder shares the folder prefix, stored once with its trailing separator
+std::vector<std::string> interned_dirs;
+std::unordered_map<std::string, uint32_t, InternedDirHash, std::equal_to<>> interned_dir_ids;
+// every folder an interned path lies below, so a folder change is recognised without walking the paths
+std::unordered_set<std::string, InternedDirHash, std::equal_to<>> interned_dir_prefixes;
+std::vector<InternedPath> interned_paths;
+// open addressing over the ids themselves, a node based map would cost more than the paths it saves
+const ImageId empty_path_slot = UINT32_MAX;
+std::vector<ImageId> interned_path_slots;
+
+std::mutex path_arena_mtx;
+
+std::string PathArenaStats::ToString()
+{
+    return std::format("PathArenaStats(paths={},dirs={},bytes={})", paths, dirs, bytes);
+}
+
+void SplitImagePath(const std::string& path, std::string_view& dir, std::string_view& name)
+{
+    size_t separator = path.find_last_of("/\\");
+    size_t split = separator == std::string::npos ? 0 : separator + 1;
+    dir = std::string_view(path).substr(0, split);
+    name = std::string_view(path).substr(split);
+}
+
+// expects path_arena_mtx to be held
+const char* StoreName(std::string_view name)
+{
+    if (name.size() > path_arena_block_size) {
+        // longer than any block, it gets one of its own and the next name starts a fresh block
+        path_arena_blocks.push_back(std::make_unique<char[]>(name.size()));
+        path_arena_block_used = path_arena_block_size;
+        path_arena_bytes += name.size();
+        std::copy(name.begin(), name.end(), path_arena_blocks.back().get());
+        return path_arena_blocks.back().get();
+    }
+
+    if (path_arena_block_size - path_arena_block_used < name.size()) {
+        path_arena_blocks.push_back(std::make_unique<char[]>(path_arena_block_size));
+        path_arena_block_used = 0;
+        path_arena_bytes += path_arena_block_size;
+    }
+
+    char* stored = path_arena_blocks.back().get() + path_arena_block_used;
+    std::copy(name.begin(), name.end(), stored);
+    path_arena_block_used += name.size();
+    return stored;
+}
+
+size_t HashImagePath(uint32_t dir, std::string_view name)
+{
+    return std::hash<std::string_view>()(name) ^ (static_cast<size_t>(dir) * 0x9E3779B97F4A7C15ull);
+}
+
+// expects path_arena_mtx to be held
+size_t FindPathSlot(uint32_t dir, std::string_view name)
+{
+    size_t mask = interned_path_slots.size() - 1;
+    for (size_t slot = HashImagePath(dir, name) & mask;; slot = (slot + 1) & mask) {
+        ImageId id = interned_path_slots[slot];
+        if (id == empty_path_slot) {
+            return slot;
+        }
+        const InternedPath& interned = interned_paths[id];
+        if (interned.dir == dir && std::string_view(interned.name, interned.nameSize) == name) {
+            return slot;
+        }
+    }
+}
+
+// expects path_arena_mtx to be held
+void GrowPathSlots()
+{
+    // kept at most half full so probes stay short
+    size_t size = std::max<size_t>(1024, interned_path_slots.size() * 2);
+    interned_path_slots.assign(size, empty_path_slot);
+
+    for (ImageId id = 0; id < interned_paths.size(); id++) {
+        const InternedPath& interned = interned_paths[id];
+        interned_path_slots[FindPathSlot(interned.dir, std::string_view(interned.name, interned.nameSize))] = id;
+    }
+}
+
+// expects path_arena_mtx to be held
+bool FindDir(std::string_view dir, uint32_t& dir_id)
+{
+    auto it = interned_dir_ids.find(dir);
+    if (it == interned_dir_ids.end()) {
+        return false;
+    }
+    dir_id = it->second;
+    return true;
+}
+
+ImageId InternImagePath(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(path_arena_mtx);
+
+    std::string_view dir;
+    std::string_view name;
+    SplitImagePath(path, dir, name);
+
+    uint32_t dir_id;
+    if (!FindDir(dir, dir_id)) {
+        dir_id = static_cast<uint32_t>(interned_dirs.size());
+        interned_dirs.emplace_back(dir);
+        interned_dir_ids.emplace(interned_dirs.back(), dir_id);
+
+        for (size_t separator = dir.find_first_of("/\\"); separator != std::string_view::npos; separator = dir.find_first_of("/\\", separator + 1)) {
+            interned_dir_prefixes.emplace(dir.substr(0, separator + 1));
+        }
+    }
+
+    if ((interned_paths.size() + 1) * 2 > interned_path_slots.size()) {
+        GrowPathSlots();
+    }
+
+    size_t slot = FindPathSlot(dir_id, name);
+    if (interned_path_slots[slot] != empty_path_slot) {
+        return interned_path_slots[slot];
+    }
+
+    if (interned_paths.size() >= empty_path_slot) {
+        throw std::runtime_error("too many image paths to intern");
+    }
+
+    // paths stay interned for the life of the process, a rescan of the same library adds nothing
+    const char* stored = StoreName(name);
+    ImageId id = static_cast<ImageId>(interned_paths.size());
+    interned_paths.push_back({ dir_id, static_cast<uint32_t>(name.size()), stored });
+    interned_path_slots[slot] = id;
+    return id;
+}
+
+bool FindImagePath(const std::string& path, ImageId& id)
+{
+    std::lock_guard<std::mutex> lock(path_arena_mtx);
+
+    std::string_view dir;
+    std::string_view name;
+    SplitImagePath(path, dir, name);
+
+    uint32_t dir_id;
+    if (!FindDir(dir, dir_id)) {
+        return false;
+    }
+
+    if (interned_path_slots.empty()) {
+        return false;
+    }
+
+    size_t slot = FindPathSlot(dir_id, name);
+    if (interned_path_slots[slot] == empty_path_slot) {
+        return false;
+    }
+    id = interned_path_slots[slot];
+    return true;
+}
+
+std::string GetImagePath(ImageId id)
+{
+    std::lock_guard<std::mutex> lock(path_arena_mtx);
+
+    const InternedPath& interned = interned_paths.at(id);
+    std::string path = interned_dirs[interned.dir];
+    path.append(interned.name, interned.nameSize);
+    return path;
+}
+
+bool ImagePathLess(ImageId id, const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(path_arena_mtx);
+
+    const InternedPath& interned = interned_paths.at(id);
+    std::string_view dir = interned_dirs[interned.dir];
+    std::string_view other = path;
+
+    // compared piecewise, the joined path is never built
+    int order = dir.compare(other.substr(0, dir.size()));
+    if (order != 0) {
+        return order < 0;
+    }
+    return std::string_view(interned.name, interned.nameSize) < other.substr(dir.size());
+}
+
+bool IsImageDirPrefix(const std::string& prefix)
+{
+    std::lock_guard<std::mutex> lock(path_arena_mtx);
+    return interned_dir_prefixes.find(prefix) != interned_dir_prefixes.end();
+}
+
+PathArenaStats GetPathArenaStats()
+{
+    std::lock_guard<std::mutex> lock(path_arena_mtx);
+
+    size_t bytes = path_arena_bytes + interned_paths.capacity() * sizeof(InternedPath) + interned_path_slots.size() * sizeof(ImageId);
+    for (const std::string& dir : interned_dirs) {
+        bytes += dir.capacity();
+    }
+    for (const std::string& prefix : interned_dir_prefixes) {
+        bytes += prefix.capacity();
+    }
+    return { interned_paths.size(), interned_dirs.size(), bytes };
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "kernels.h"
+#include "log.h"
+
+#include <cstring>
+#include <format>
+
+#if defined(WF_KERNELS_X86) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace wallflow {
+
+template void ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::RGB>(const uint8_t*, uint8_t*, size_t);
+template void ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::BGR>(const uint8_t*, uint8_t*, size_t);
+template void ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGR>(const uint8_t*, uint8_t*, size_t);
+template void ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGRX>(const uint8_t*, uint8_t*, size_t);
+template void ConvertPixelsScalar<PixelFormat::BGR, PixelFormat::BGRX>(const uint8_t*, uint8_t*, size_t);
+
+void FillScalar(uint8_t* dst, size_t count, const uint8_t* pixel)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[0] = pixel[0];
+        dst[1] = pixel[1];
+        dst[2] = pixel[2];
+        dst += 3;
+    }
+}
+
+void SwapRowsScalar(uint8_t* first, uint8_t* second, size_t size)
+{
+    uint8_t tmp[256];
+
+    while (size > 0) {
+        size_t chunk = size < sizeof(tmp) ? size : sizeof(tmp);
+        memcpy(tmp, first, chunk);
+        memcpy(first, second, chunk);
+        memcpy(second, tmp, chunk);
+        first += chunk;
+        second += chunk;
+        size -= chunk;
+    }
+}
+
+uint8_t ClampResampled(int32_t value)
+{
+    value >>= resample_precision;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void ResampleHorizontalScalar(const uint8_t* src, size_t, uint8_t* dst, size_t dst_width, const int32_t* starts, const int16_t* weights, int taps)
+{
+    const int32_t round = 1 << (resample_precision - 1);
+
+    for (size_t x = 0; x < dst_width; x++) {
+        const uint8_t* p = src + starts[x] * 3;
+        const int16_t* w = weights + x * taps;
+        int32_t b = round;
+        int32_t g = round;
+        int32_t r = round;
+
+        for (int k = 0; k < taps; k++) {
+            b += p[0] * w[k];
+            g += p[1] * w[k];
+            r += p[2] * w[k];
+            p += 3;
+        }
+
+        dst[0] = ClampResampled(b);
+        dst[1] = ClampResampled(g);
+        dst[2] = ClampResampled(r);
+        dst += 3;
+    }
+}
+
+void ResampleVerticalScalar(const uint8_t* const* rows, uint8_t* dst, size_t size, const int16_t* weights, int taps)
+{
+    const int32_t round = 1 << (resample_precision - 1);
+
+    for (size_t i = 0; i < size; i++) {
+        int32_t sum = round;
+        for (int k = 0; k < taps; k++) {
+            sum += rows[k][i] * weights[k];
+        }
+        dst[i] = ClampResampled(sum);
+    }
+}
+
+const PixelKernels scalar_kernels = {
+    "scalar",
+    ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::RGB>,
+    ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::BGR>,
+    ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGR>,
+    ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGRX>,
+    ConvertPixelsScalar<PixelFormat::BGR, PixelFormat::BGRX>,
+    FillScalar,
+    SwapRowsScalar,
+    ResampleHorizontalScalar,
+    ResampleVerticalScalar,
+};
+
+const PixelKernels& GetScalarKernels()
+{
+    return scalar_kernels;
+}
+
+#ifdef WF_KERNELS_X86
+
+struct CPUFeatures {
+    bool sse2;
+    bool ssse3;
+    bool avx2;
+};
+
+CPUFeatures DetectCPUFeatures()
+{
+    CPUFeatures features = {};
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    features.ssse3 = (info[2] & (1 << 9)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.ssse3 = __builtin_cpu_supports("ssse3");
+    features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    return features;
+}
+
+#endif
+
+std::vector<const PixelKernels*> GetSupportedPixelKernels()
+{
+    std::vector<const PixelKernels*> supported = { &GetScalarKernels() };
+
+#ifdef WF_KERNELS_X86
+    CPUFeatures features = DetectCPUFeatures();
+
+    if (features.sse2) {
+        supported.push_back(&GetSSE2Kernels());
+    }
+    if (features.ssse3) {
+        supported.push_back(&GetSSSE3Kernels());
+    }
+    if (features.avx2) {
+        supported.push_back(&GetAVX2Kernels());
+    }
+#endif
+
+    return supported;
+}
+
+const PixelKernels& SelectPixelKernels()
+{
+    const PixelKernels& kernels = *GetSupportedPixelKernels().back();
+    WF_LOG(LogLevel::LINFO, "using {} pixel kernels", kernels.name);
+    return kernels;
+}
+
+const PixelKernels& GetPixelKernels()
+{
+    static const PixelKernels& kernels = SelectPixelKernels();
+    return kernels;
+}
+
+void FlipRows(uint8_t* data, size_t stride, size_t rows)
+{
+    if (rows < 2) {
+        return;
+    }
+
+    const PixelKernels& kernels = GetPixelKernels();
+
+    for (size_t top = 0, bottom = rows - 1; top < bottom; top++, bottom--) {
+        kernels.swapRows(data + top * stride, data + bottom * stride, stride);
+    }
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "kernels.h"
+
+#ifdef WF_KERNELS_X86
+
+#include <immintrin.h>
+
+namespace wallflow {
+
+namespace {
+
+template <PixelFormat Src, PixelFormat Dst>
+__m256i ShuffleMask()
+{
+    using S = PixelLayout<Src>;
+    using D = PixelLayout<Dst>;
+
+    alignas(16) int8_t mask[16];
+    for (int i = 0; i < 16; i++) {
+        mask[i] = static_cast<int8_t>(0x80);
+    }
+
+    int pixels = 16 / (S::size > D::size ? S::size : D::size);
+    for (int p = 0; p < pixels; p++) {
+        mask[p * D::size + D::r] = static_cast<int8_t>(p * S::size + S::r);
+        mask[p * D::size + D::g] = static_cast<int8_t>(p * S::size + S::g);
+        mask[p * D::size + D::b] = static_cast<int8_t>(p * S::size + S::b);
+    }
+
+    return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(mask)));
+}
+
+template <PixelFormat Dst>
+__m256i AlphaMask()
+{
+    using D = PixelLayout<Dst>;
+
+    alignas(32) uint8_t mask[32] = {};
+    for (int p = 0; p < 8; p++) {
+        mask[p * 4 + D::a] = 0xFF;
+    }
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(mask));
+}
+
+__m256i LoadLanes(const uint8_t* low, const uint8_t* high)
+{
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+template <PixelFormat Src, PixelFormat Dst>
+void Convert4To3AVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    const __m256i mask = ShuffleMask<Src, Dst>();
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        __m256i out = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(in, mask), pack);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm256_castsi256_si128(out));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i * 3 + 16), _mm256_extracti128_si256(out, 1));
+    }
+
+    ConvertPixelsScalar<Src, Dst>(src + i * 4, dst + i * 3, count - i);
+}
+
+template <PixelFormat Src, PixelFormat Dst>
+void Convert3To4AVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    const __m256i mask = ShuffleMask<Src, Dst>();
+    const __m256i alpha = AlphaMask<Dst>();
+    size_t i = 0;
+
+    // each lane reads 16 bytes for 4 pixels, so keep 4 bytes of slack at the end
+    for (; i + 10 <= count; i += 8) {
+        __m256i in = LoadLanes(src + i * 3, src + i * 3 + 12);
+        __m256i out = _mm256_or_si256(_mm256_shuffle_epi8(in, mask), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), out);
+    }
+
+    ConvertPixelsScalar<Src, Dst>(src + i * 3, dst + i * 4, count - i);
+}
+
+void SwapRedBlueAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    // ten pixels per iteration as two overlapping 15 byte lanes, the low lane
+    // is stored first so its pass-through byte is overwritten by the high lane
+    const __m256i mask = _mm256_setr_epi8(
+        2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+        2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    size_t size = count * 3;
+    size_t i = 0;
+
+    for (; i + 31 <= size; i += 30) {
+        __m256i out = _mm256_shuffle_epi8(LoadLanes(src + i, src + i + 15), mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(out));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 15), _mm256_extracti128_si256(out, 1));
+    }
+
+    ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGR>(src + i, dst + i, (size - i) / 3);
+}
+
+void FillAVX2(uint8_t* dst, size_t count, const uint8_t* pixel)
+{
+    alignas(32) uint8_t pattern[96];
+    for (int i = 0; i < 96; i += 3) {
+        pattern[i + 0] = pixel[0];
+        pattern[i + 1] = pixel[1];
+        pattern[i + 2] = pixel[2];
+    }
+
+    const __m256i v0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(pattern + 0));
+    const __m256i v1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(pattern + 32));
+    const __m256i v2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(pattern + 64));
+    size_t i = 0;
+
+    for (; i + 32 <= count; i += 32) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 3 + 0), v0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 3 + 32), v1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 3 + 64), v2);
+    }
+
+    GetScalarKernels().fill(dst + i * 3, count - i, pixel);
+}
+
+void SwapRowsAVX2(uint8_t* first, uint8_t* second, size_t size)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(first + i), b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(second + i), a);
+    }
+
+    GetScalarKernels().swapRows(first + i, second + i, size - i);
+}
+
+__m256i WeightPairAVX2(int16_t w0, int16_t w1)
+{
+    return _mm256_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(w0) | (static_cast<uint32_t>(static_cast<uint16_t>(w1)) << 16)));
+}
+
+void ResampleVerticalAVX2(const uint8_t* const* rows, uint8_t* dst, size_t size, const int16_t* weights, int taps)
+{
+    const __m256i round = _mm256_set1_epi32(1 << (resample_precision - 1));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    // unpack and pack both work within 128-bit lanes, so the byte order
+    // survives the round trip without any cross-lane permutes
+    for (; i + 32 <= size; i += 32) {
+        __m256i sum0 = round;
+        __m256i sum1 = round;
+        __m256i sum2 = round;
+        __m256i sum3 = round;
+
+        for (int k = 0; k < taps; k += 2) {
+            int next = k + 1 < taps ? k + 1 : k;
+            __m256i weight = WeightPairAVX2(weights[k], k + 1 < taps ? weights[k + 1] : 0);
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[next] + i));
+            __m256i lo = _mm256_unpacklo_epi8(a, b);
+            __m256i hi = _mm256_unpackhi_epi8(a, b);
+
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), weight));
+            sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), weight));
+            sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), weight));
+            sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), weight));
+        }
+
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(sum0, resample_precision), _mm256_srai_epi32(sum1, resample_precision));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(sum2, resample_precision), _mm256_srai_epi32(sum3, resample_precision));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    for (; i < size; i++) {
+        int32_t sum = 1 << (resample_precision - 1);
+        for (int k = 0; k < taps; k++) {
+            sum += rows[k][i] * weights[k];
+        }
+        sum >>= resample_precision;
+        dst[i] = static_cast<uint8_t>(sum < 0 ? 0 : (sum > 255 ? 255 : sum));
+    }
+}
+
+}
+
+const PixelKernels& GetAVX2Kernels()
+{
+    // not a global, the ssse3 table may not be initialized yet when globals are
+    static const PixelKernels kernels = {
+        "avx2",
+        Convert4To3AVX2<PixelFormat::RGBA, PixelFormat::RGB>,
+        Convert4To3AVX2<PixelFormat::RGBA, PixelFormat::BGR>,
+        SwapRedBlueAVX2,
+        Convert3To4AVX2<PixelFormat::RGB, PixelFormat::BGRX>,
+        Convert3To4AVX2<PixelFormat::BGR, PixelFormat::BGRX>,
+        FillAVX2,
+        SwapRowsAVX2,
+        // a pixel is narrower than a 128-bit register, wider vectors do not help here
+        GetSSSE3Kernels().resampleHorizontal,
+        ResampleVerticalAVX2,
+    };
+    return kernels;
+}
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include "kernels.h"
+
+#ifdef WF_KERNELS_X86
+
+#include <cstring>
+#include <emmintrin.h>
+
+namespace wallflow {
+
+namespace {
+
+__m128i LoadPixelSSE2(const uint8_t* p)
+{
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(value), _mm_setzero_si128());
+}
+
+__m128i WeightPairSSE2(int16_t w0, int16_t w1)
+{
+    return _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(w0) | (static_cast<uint32_t>(static_cast<uint16_t>(w1)) << 16)));
+}
+
+void FillSSE2(uint8_t* dst, size_t count, const uint8_t* pixel)
+{
+    alignas(16) uint8_t pattern[48];
+    for (int i = 0; i < 48; i += 3) {
+        pattern[i + 0] = pixel[0];
+        pattern[i + 1] = pixel[1];
+        pattern[i + 2] = pixel[2];
+    }
+
+    const __m128i v0 = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern + 0));
+    const __m128i v1 = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern + 16));
+    const __m128i v2 = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern + 32));
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 0), v0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 16), v1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 32), v2);
+    }
+
+    GetScalarKernels().fill(dst + i * 3, count - i, pixel);
+}
+
+void SwapRowsSSE2(uint8_t* first, uint8_t* second, size_t size)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(first + i), b);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(second + i), a);
+    }
+
+    GetScalarKernels().swapRows(first + i, second + i, size - i);
+}
+
+void ResampleHorizontalSSE2(const uint8_t* src, size_t src_width, uint8_t* dst, size_t dst_width, const int32_t* starts, const int16_t* weights, int taps)
+{
+    const __m128i round = _mm_set1_epi32(1 << (resample_precision - 1));
+
+    for (size_t x = 0; x < dst_width; x++) {
+        // a pixel load reads one byte past the pixel, which must stay inside the row
+        if (static_cast<size_t>(starts[x]) + taps + 1 > src_width) {
+            GetScalarKernels().resampleHorizontal(src, src_width, dst + x * 3, 1, starts + x, weights + x * taps, taps);
+            continue;
+        }
+
+        const uint8_t* p = src + starts[x] * 3;
+        const int16_t* w = weights + x * taps;
+        __m128i sum = round;
+        int k = 0;
+
+        // without pshufb two pixels are interleaved word by word, one madd per pair of taps
+        for (; k + 2 <= taps; k += 2) {
+            __m128i pair = _mm_unpacklo_epi16(LoadPixelSSE2(p + k * 3), LoadPixelSSE2(p + k * 3 + 3));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, WeightPairSSE2(w[k], w[k + 1])));
+        }
+        if (k < taps) {
+            __m128i pair = _mm_unpacklo_epi16(LoadPixelSSE2(p + k * 3), _mm_setzero_si128());
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, WeightPairSSE2(w[k], 0)));
+        }
+
+        sum = _mm_srai_epi32(sum, resample_precision);
+        sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), _mm_setzero_si128());
+        int32_t out = _mm_cvtsi128_si32(sum);
+        memcpy(dst + x * 3, &out, 3);
+    }
+}
+
+void ResampleVerticalSSE2(const uint8_t* const* rows, uint8_t* dst, size_t size, const int16_t* weights, int taps)
+{
+    const __m128i round = _mm_set1_epi32(1 << (resample_precision - 1));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i sum0 = round;
+        __m128i sum1 = round;
+        __m128i sum2 = round;
+        __m128i sum3 = round;
+
+        for (int k = 0; k < taps; k += 2) {
+            // an odd last tap is paired with itself at zero weight
+            int next = k + 1 < taps ? k + 1 : k;
+            __m128i weight = WeightPairSSE2(weights[k], k + 1 < taps ? weights[k + 1] : 0);
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[next] + i));
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+
+            sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), weight));
+            sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), weight));
+            sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), weight));
+            sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), weight));
+        }
+
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(sum0, resample_precision), _mm_srai_epi32(sum1, resample_precision));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(sum2, resample_precision), _mm_srai_epi32(sum3, resample_precision));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    for (; i < size; i++) {
+        int32_t sum = 1 << (resample_precision - 1);
+        for (int k = 0; k < taps; k++) {
+            sum += rows[k][i] * weights[k];
+        }
+        sum >>= resample_precision;
+        dst[i] = static_cast<uint8_t>(sum < 0 ? 0 : (sum > 255 ? 255 : sum));
+    }
+}
+
+}
+
+// SSE2 has no byte shuffle, so the channel swizzles of 3-byte pixels stay scalar
+const PixelKernels sse2_kernels = {
+    "sse2",
+    ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::RGB>,
+    ConvertPixelsScalar<PixelFormat::RGBA, PixelFormat::BGR>,
+    ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGR>,
+    ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGRX>,
+    ConvertPixelsScalar<PixelFormat::BGR, PixelFormat::BGRX>,
+    FillSSE2,
+    SwapRowsSSE2,
+    ResampleHorizontalSSE2,
+    ResampleVerticalSSE2,
+};
+
+const PixelKernels& GetSSE2Kernels()
+{
+    return sse2_kernels;
+}
+
+}
+
+#endif
\ No newline at end of file
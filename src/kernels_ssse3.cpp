@@ -0,0 +1,190 @@
+#include "kernels.h"
+
+#ifdef WF_KERNELS_X86
+
+#include <cstring>
+#include <tmmintrin.h>
+
+namespace wallflow {
+
+namespace {
+
+// Builds the pshufb mask that moves up to 16 / Dst::size pixels of Src into
+// Dst order within one register. Unused lanes are zeroed (0x80).
+template <PixelFormat Src, PixelFormat Dst>
+__m128i ShuffleMask()
+{
+    using S = PixelLayout<Src>;
+    using D = PixelLayout<Dst>;
+
+    alignas(16) int8_t mask[16];
+    for (int i = 0; i < 16; i++) {
+        mask[i] = static_cast<int8_t>(0x80);
+    }
+
+    int pixels = 16 / (S::size > D::size ? S::size : D::size);
+    for (int p = 0; p < pixels; p++) {
+        mask[p * D::size + D::r] = static_cast<int8_t>(p * S::size + S::r);
+        mask[p * D::size + D::g] = static_cast<int8_t>(p * S::size + S::g);
+        mask[p * D::size + D::b] = static_cast<int8_t>(p * S::size + S::b);
+    }
+
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+template <PixelFormat Dst>
+__m128i AlphaMask()
+{
+    using D = PixelLayout<Dst>;
+
+    alignas(16) uint8_t mask[16] = {};
+    for (int p = 0; p < 4; p++) {
+        mask[p * 4 + D::a] = 0xFF;
+    }
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+template <PixelFormat Src, PixelFormat Dst>
+void Convert4To3SSSE3(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    const __m128i mask = ShuffleMask<Src, Dst>();
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 0)), mask);
+        __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 16)), mask);
+        __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 32)), mask);
+        __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 48)), mask);
+
+        __m128i out0 = _mm_or_si128(p0, _mm_slli_si128(p1, 12));
+        __m128i out1 = _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8));
+        __m128i out2 = _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 0), out0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 16), out1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 32), out2);
+    }
+
+    ConvertPixelsScalar<Src, Dst>(src + i * 4, dst + i * 3, count - i);
+}
+
+template <PixelFormat Src, PixelFormat Dst>
+void Convert3To4SSSE3(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    const __m128i mask = ShuffleMask<Src, Dst>();
+    const __m128i alpha = AlphaMask<Dst>();
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i in0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 0));
+        __m128i in1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 16));
+        __m128i in2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 32));
+
+        __m128i p0 = _mm_shuffle_epi8(in0, mask);
+        __m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(in1, in0, 12), mask);
+        __m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(in2, in1, 8), mask);
+        __m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(in2, 4), mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 0), _mm_or_si128(p0, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_or_si128(p1, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 32), _mm_or_si128(p2, alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 48), _mm_or_si128(p3, alpha));
+    }
+
+    ConvertPixelsScalar<Src, Dst>(src + i * 3, dst + i * 4, count - i);
+}
+
+void SwapRedBlueSSSE3(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    // five pixels per register, the 16th byte is passed through untouched and
+    // rewritten by the next iteration, which also keeps in-place use safe
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    size_t size = count * 3;
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 15) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(in, mask));
+    }
+
+    ConvertPixelsScalar<PixelFormat::RGB, PixelFormat::BGR>(src + i, dst + i, (size - i) / 3);
+}
+
+__m128i LoadPixelSSE2(const uint8_t* p)
+{
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(value), _mm_setzero_si128());
+}
+
+__m128i WeightPairSSE2(int16_t w0, int16_t w1)
+{
+    return _mm_set1_epi32(static_cast<int32_t>(static_cast<uint16_t>(w0) | (static_cast<uint32_t>(static_cast<uint16_t>(w1)) << 16)));
+}
+
+void ResampleHorizontalSSSE3(const uint8_t* src, size_t src_width, uint8_t* dst, size_t dst_width, const int32_t* starts, const int16_t* weights, int taps)
+{
+    // spread two adjacent BGR pixels into (b0, b1, g0, g1, r0, r1) words so
+    // one madd applies a pair of taps to all three channels
+    const __m128i pair01 = _mm_setr_epi8(0, -1, 3, -1, 1, -1, 4, -1, 2, -1, 5, -1, -1, -1, -1, -1);
+    const __m128i pair23 = _mm_setr_epi8(6, -1, 9, -1, 7, -1, 10, -1, 8, -1, 11, -1, -1, -1, -1, -1);
+    const __m128i round = _mm_set1_epi32(1 << (resample_precision - 1));
+
+    for (size_t x = 0; x < dst_width; x++) {
+        // the wide loads run a few bytes past the last tap, which must stay inside the row
+        if (static_cast<size_t>(starts[x]) + taps + 2 > src_width) {
+            GetScalarKernels().resampleHorizontal(src, src_width, dst + x * 3, 1, starts + x, weights + x * taps, taps);
+            continue;
+        }
+
+        const uint8_t* p = src + starts[x] * 3;
+        const int16_t* w = weights + x * taps;
+        __m128i sum = round;
+        int k = 0;
+
+        for (; k + 4 <= taps; k += 4) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * 3));
+            __m128i pairs = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(w + k));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_shuffle_epi8(pixels, pair01), _mm_shuffle_epi32(pairs, 0x00)));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_shuffle_epi8(pixels, pair23), _mm_shuffle_epi32(pairs, 0x55)));
+        }
+        for (; k + 2 <= taps; k += 2) {
+            __m128i pair = _mm_unpacklo_epi16(LoadPixelSSE2(p + k * 3), LoadPixelSSE2(p + k * 3 + 3));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, WeightPairSSE2(w[k], w[k + 1])));
+        }
+        if (k < taps) {
+            __m128i pair = _mm_unpacklo_epi16(LoadPixelSSE2(p + k * 3), _mm_setzero_si128());
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, WeightPairSSE2(w[k], 0)));
+        }
+
+        sum = _mm_srai_epi32(sum, resample_precision);
+        sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), _mm_setzero_si128());
+        int32_t out = _mm_cvtsi128_si32(sum);
+        memcpy(dst + x * 3, &out, 3);
+    }
+}
+
+}
+
+const PixelKernels& GetSSSE3Kernels()
+{
+    // built on first use, it borrows entries from tables in other files
+    static const PixelKernels kernels = {
+        "ssse3",
+        Convert4To3SSSE3<PixelFormat::RGBA, PixelFormat::RGB>,
+        Convert4To3SSSE3<PixelFormat::RGBA, PixelFormat::BGR>,
+        SwapRedBlueSSSE3,
+        Convert3To4SSSE3<PixelFormat::RGB, PixelFormat::BGRX>,
+        Convert3To4SSSE3<PixelFormat::BGR, PixelFormat::BGRX>,
+        // nothing in these needs a byte shuffle
+        GetSSE2Kernels().fill,
+        GetSSE2Kernels().swapRows,
+        ResampleHorizontalSSSE3,
+        GetSSE2Kernels().resampleVertical,
+    };
+    return kernels;
+}
+
+}
+
+#endif
\ No newline at end of file
@@ -1,15 +1,20 @@
 #include "log.h"
 
-std::string normalizeFilePath(const char* path)
-{
-    std::string normalizedPath(path);
-    std::replace(normalizedPath.begin(), normalizedPath.end(), '\\', '/');
-    return normalizedPath;
-}
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 std::string logLevelToString(LogLevel level)
 {
     switch (level) {
+    case LogLevel::LDEBUG:
+        return "DEBUG";
     case LogLevel::LINFO:
         return "INFO";
     case LogLevel::LWARNING:
@@ -23,5 +28,248 @@ std::string logLevelToString(LogLevel level)
     }
 }
 
-const std::string normalizedProjectRoot = normalizeFilePath(PROJECT_ROOT) + "/";
-std::map<std::string, std::chrono::high_resolution_clock::time_point> timer_times;
\ No newline at end of file
+namespace wallflow {
+
+struct LogRecord {
+    LogLevel level;
+    const char* file;
+    int line;
+    std::chrono::system_clock::time_point time;
+    std::string message;
+};
+
+// lines queued between two sink passes, the ones past it are counted and dropped
+const size_t log_queue_capacity = 4096;
+const size_t log_file_max_size = 4 * 1024 * 1024;
+// rotated files kept next to wallflow.log
+const int log_file_backups = 3;
+
+// Callers fill the queue, the sink writes the batch. They are swapped on every
+// pass so the messages of both keep their capacity and queueing a line stops
+// allocating once the buffers have grown.
+std::vector<LogRecord> log_queue(log_queue_capacity);
+std::vector<LogRecord> log_batch(log_queue_capacity);
+size_t log_queue_size = 0;
+uint64_t log_dropped = 0;
+// every line ever queued (dropped ones included) and how many of them are written
+uint64_t log_queued = 0;
+uint64_t log_written = 0;
+bool log_stopped = false;
+std::thread log_thread;
+
+std::mutex log_mtx;
+std::condition_variable log_queue_cv;
+std::condition_variable log_flush_cv;
+
+// only the sink writes, or the callers themselves once it is stopped
+std::string log_directory;
+std::ofstream log_file;
+size_t log_file_size = 0;
+std::string log_lines;
+
+std::mutex log_write_mtx;
+
+thread_local std::string log_buffer;
+
+std::string& GetLogBuffer()
+{
+    return log_buffer;
+}
+
+std::string GetLogFilePath(int index)
+{
+    if (index == 0) {
+        return std::format("{}/wallflow.log", log_directory);
+    }
+    return std::format("{}/wallflow.{}.log", log_directory, index);
+}
+
+// expects log_write_mtx to be held
+void RotateLogFiles()
+{
+    log_file.close();
+
+    // missing files are fine, the oldest one is overwritten
+    std::error_code ec;
+    for (int i = log_file_backups; i > 0; i--) {
+        std::filesystem::rename(GetLogFilePath(i - 1), GetLogFilePath(i), ec);
+    }
+
+    log_file.open(GetLogFilePath(0), std::ios::binary | std::ios::trunc);
+    log_file_size = 0;
+}
+
+// expects log_write_mtx to be held
+void FormatLogRecord(const LogRecord& record)
+{
+    std::time_t now = std::chrono::system_clock::to_time_t(record.time);
+    char timestamp[32];
+    size_t timestamp_length = std::strftime(timestamp, sizeof(timestamp), "%F %T", std::localtime(&now));
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(record.time.time_since_epoch()).count() % 1000;
+
+    log_lines.append(timestamp, timestamp_length);
+    std::format_to(std::back_inserter(log_lines), ".{:03} ", millis);
+    for (const char* c = record.file; *c != '\0'; c++) {
+        log_lines += *c == '\\' ? '/' : *c;
+    }
+    std::format_to(std::back_inserter(log_lines), ":{} [{}] {}\n", record.line, logLevelToString(record.level), record.message);
+}
+
+// expects log_write_mtx to be held
+void WriteLogRecords(const LogRecord* records, size_t count, uint64_t dropped)
+{
+    log_lines.clear();
+    if (dropped > 0) {
+        FormatLogRecord({ LogLevel::LWARNING, WF_LOG_FILE(), __LINE__, std::chrono::system_clock::now(), std::format("dropped {} log lines, the queue was full", dropped) });
+    }
+    for (size_t i = 0; i < count; i++) {
+        FormatLogRecord(records[i]);
+    }
+
+#ifdef ENABLE_LOGGING
+    std::cout.write(log_lines.data(), static_cast<std::streamsize>(log_lines.size()));
+    std::cout.flush();
+#endif
+
+    if (log_file.is_open()) {
+        if (log_file_size + log_lines.size() > log_file_max_size) {
+            RotateLogFiles();
+        }
+        log_file.write(log_lines.data(), static_cast<std::streamsize>(log_lines.size()));
+        log_file.flush();
+        log_file_size += log_lines.size();
+    }
+}
+
+void RunLogSink()
+{
+    std::unique_lock<std::mutex> lock(log_mtx);
+
+    while (true) {
+        log_queue_cv.wait(lock, [] { return log_queue_size > 0 || log_dropped > 0 || log_stopped; });
+        if (log_queue_size == 0 && log_dropped == 0) {
+            break;
+        }
+
+        std::swap(log_queue, log_batch);
+        size_t count = log_queue_size;
+        uint64_t dropped = log_dropped;
+        uint64_t queued = log_queued;
+        log_queue_size = 0;
+        log_dropped = 0;
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> write_lock(log_write_mtx);
+            WriteLogRecords(log_batch.data(), count, dropped);
+        }
+
+        lock.lock();
+        log_written = queued;
+        log_flush_cv.notify_all();
+    }
+
+    log_flush_cv.notify_all();
+}
+
+void WriteLog(LogLevel level, const char* file, int line, std::string_view message)
+{
+    auto time = std::chrono::system_clock::now();
+    std::unique_lock<std::mutex> lock(log_mtx);
+
+    // errors wait for room in the queue rather than being dropped
+    if (level >= LogLevel::LERROR) {
+        log_flush_cv.wait(lock, [] { return log_queue_size < log_queue.size() || log_stopped; });
+    }
+
+    if (log_stopped) {
+        // nothing drains the queue anymore, the caller writes its own line
+        LogRecord record = { level, file, line, time, std::string(message) };
+        lock.unlock();
+        std::lock_guard<std::mutex> write_lock(log_write_mtx);
+        WriteLogRecords(&record, 1, 0);
+        return;
+    }
+
+    if (!log_thread.joinable()) {
+        log_thread = std::thread(RunLogSink);
+    }
+
+    // the sink only sleeps on an empty queue, so only the first line of a batch wakes it
+    bool wake = log_queue_size == 0 && log_dropped == 0;
+    log_queued++;
+    if (log_queue_size < log_queue.size()) {
+        LogRecord& record = log_queue[log_queue_size++];
+        record.level = level;
+        record.file = file;
+        record.line = line;
+        record.time = time;
+        record.message.assign(message);
+    } else {
+        log_dropped++;
+    }
+    lock.unlock();
+
+    if (wake) {
+        log_queue_cv.notify_one();
+    }
+    if (level == LogLevel::LFATAL) {
+        FlushLog();
+    }
+}
+
+void SetLogDirectory(const std::string& directory)
+{
+    std::string log_path;
+    bool opened = false;
+    {
+        std::lock_guard<std::mutex> write_lock(log_write_mtx);
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        log_directory = directory;
+        log_path = GetLogFilePath(0);
+        log_file.close();
+        log_file.open(log_path, std::ios::binary | std::ios::app);
+        opened = log_file.is_open();
+        log_file_size = opened ? static_cast<size_t>(std::filesystem::file_size(log_path, ec)) : 0;
+    }
+
+    if (!opened) {
+        WF_LOG(LogLevel::LWARNING, "could not open log file ({}), logging to files is disabled", log_path);
+        return;
+    }
+    WF_LOG(LogLevel::LINFO, "logging to {}", log_path);
+}
+
+void FlushLog()
+{
+    std::unique_lock<std::mutex> lock(log_mtx);
+    uint64_t queued = log_queued;
+    log_flush_cv.wait(lock, [queued] { return log_written >= queued || !log_thread.joinable(); });
+}
+
+void StopLogger()
+{
+    std::thread sink;
+    {
+        std::lock_guard<std::mutex> lock(log_mtx);
+        log_stopped = true;
+        sink = std::move(log_thread);
+    }
+
+    log_queue_cv.notify_one();
+    if (sink.joinable()) {
+        sink.join();
+    }
+}
+
+// joins the sink before the queues above are destroyed
+struct LogShutdown {
+    ~LogShutdown()
+    {
+        StopLogger();
+    }
+} log_shutdown;
+
+}
\ No newline at end of file
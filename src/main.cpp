@@ -1,11 +1,17 @@
+#include "canvas.h"
 #include "config.h"
+#include "cycles.h"
 #include "displays.h"
 #include "log.h"
 #include "mem.h"
+#include "metrics.h"
 #include "paths.h"
 #include "repo.h"
+#include "trace.h"
+#include "watch.h"
 #include "wallpapers.h"
 #include "window.h"
+#include "workers.h"
 
 #include <csignal>
 #include <iostream>
@@ -14,51 +20,40 @@
 
 void cleanup()
 {
-    WF_START_TIMER("cleanup()");
+    WF_TRACE_SCOPE("cleanup");
     try {
-        wallflow::DeleteAllFileMemoryBuffers();
+        wallflow::StopWallpaperCycles();
+        wallflow::FlushDisplayAliases();
+        wallflow::StopMetricsWriter();
+        wallflow::StopDirectoryWatcher();
+        wallflow::StopWorkerPool();
+        wallflow::ReleaseCanvases();
+        wallflow::DeleteAllMemoryBuffers();
         wallflow::should_exit = true;
     } catch (const std::exception& ex) {
         WF_LOG(LogLevel::LERROR, ex.what());
     }
-    WF_END_TIMER("cleanup()");
-}
-
-std::atomic<std::chrono::steady_clock::time_point> last_run_at;
-
-void cycleWallpapers()
-{
-    while (!wallflow::should_exit) {
-        auto current_time = std::chrono::steady_clock::now();
-        auto interval = std::chrono::duration_cast<std::chrono::seconds>(current_time - last_run_at.load()).count();
-
-        if (interval >= wallflow::config->cycleSpeed) {
-            WF_LOG(LogLevel::LINFO, "scheduled wallpaper cycle");
-            wallflow::CycleAllDisplays();
-            last_run_at = current_time;
-        }
-
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
 }
 
 void initResources()
 {
     WF_LOG(LogLevel::LINFO, "initialising resources");
-    WF_START_TIMER("initResources()");
+    WF_TRACE_SCOPE("initResources");
     wallflow::CreateAppDataDir();
+    wallflow::SetLogDirectory(wallflow::GetAppDataPath("logs"));
     wallflow::LoadConfig();
+    wallflow::StartMetricsWriter(wallflow::GetAppDataPath("metrics.txt"), wallflow::config->metricsInterval);
     wallflow::LoadDisplays();
     wallflow::PopulateAllRepos();
     wallflow::RemoveOldFileMemoryBuffers();
     wallflow::InitWindow();
-    WF_END_TIMER("initResources()");
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
 
     try {
+        wallflow::SetTraceThreadName("ui");
 
 #ifdef ENABLE_LOGGING
         AllocConsole();
@@ -67,8 +62,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 #endif
 
         initResources();
-
-        std::thread cycleWallpapersThread(cycleWallpapers);
+        wallflow::StartWallpaperCycles();
 
         MSG msg;
         while (GetMessage(&msg, NULL, 0, 0)) {
@@ -77,7 +71,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         }
 
         cleanup();
-        cycleWallpapersThread.join();
+
+        wallflow::StopLogger();
 
 #ifdef ENABLE_LOGGING
         FreeConsole();
@@ -87,6 +82,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
     } catch (const std::exception& ex) {
         WF_LOG(LogLevel::LFATAL, ex.what());
+        wallflow::StopLogger();
         return 1;
     }
     return 0;
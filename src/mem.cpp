@@ -1,160 +1,276 @@
 #include "mem.h"
+#include "config.h"
 #include "log.h"
+#include "metrics.h"
 #include "paths.h"
+#include "platform.h"
 
-#include <cstdint>
 #include <filesystem>
 #include <format>
-#include <fstream>
-#include <limits>
-#include <map>
-#include <random>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
 namespace wallflow {
 
-std::map<uint16_t, FileMemoryBuffer> file_memory_buffers;
+struct MemoryBufferSlot {
+    MemoryBuffer buffer;
+    uint16_t generation;
+    bool used;
+};
 
-uint16_t CreateFileMemoryBufferKey()
-{
-    uint16_t key = 0;
-    bool valid_key = false;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    uint16_t min_value = 10000;
-    uint16_t max_value = std::numeric_limits<uint16_t>::max();
-
-    do {
+// pages are committed in these steps, it is also the allocation granularity of MapViewOfFile
+const size_t memory_buffer_granularity = 64 * 1024;
 
-        std::uniform_int_distribution<uint16_t> dis(min_value, max_value);
-        uint16_t value = dis(gen);
+// released scratch mappings are kept for the next cycle, within these limits
+const size_t memory_pool_idle_limit = 8;
+const size_t memory_pool_idle_bytes = 512 * 1024 * 1024;
 
-        std::map<uint16_t, FileMemoryBuffer>::iterator it = file_memory_buffers.find(value);
+std::vector<MemoryBufferSlot> memory_buffer_slots;
+std::vector<uint16_t> free_memory_buffer_slots;
+std::vector<MemoryBuffer> idle_memory_buffers;
+MemoryPoolStats memory_pool_stats = {};
+bool large_pages_failed = false;
 
-        if (it == file_memory_buffers.end()) {
-            key = value;
-        }
+std::mutex memory_buffers_mtx;
 
-    } while (key == 0);
+std::string MemoryBuffer::ToString()
+{
+    return std::format(
+        "MemoryBuffer(size={},capacity={},fileBacked={},largePages={},filePath={})",
+        size,
+        capacity,
+        fileBacked,
+        largePages,
+        filePath);
+}
 
-    return key;
+std::string MemoryPoolStats::ToString()
+{
+    return std::format(
+        "MemoryPoolStats(maps={},reuses={},unmaps={},live={},idle={},idleBytes={})",
+        maps,
+        reuses,
+        unmaps,
+        live,
+        idle,
+        idleBytes);
 }
 
-void DeleteFileMemoryBuffer(uint16_t key)
+size_t RoundUpTo(size_t size, size_t granularity)
 {
-    WF_LOG(LogLevel::LINFO, std::format("deleting file memory buffer ({})", key));
+    return (size + granularity - 1) / granularity * granularity;
+}
 
-    std::map<uint16_t, FileMemoryBuffer>::iterator it = file_memory_buffers.find(key);
-    if (it == file_memory_buffers.end()) {
-        WF_LOG(LogLevel::LWARNING, std::format("could not find file memory buffer {}", key));
+// expects memory_buffers_mtx to be held
+MemoryBufferHandle AllocateSlot(const MemoryBuffer& buffer)
+{
+    uint16_t index;
+    if (!free_memory_buffer_slots.empty()) {
+        index = free_memory_buffer_slots.back();
+        free_memory_buffer_slots.pop_back();
+    } else {
+        if (memory_buffer_slots.size() > UINT16_MAX) {
+            throw std::runtime_error("too many memory buffers");
+        }
+        index = static_cast<uint16_t>(memory_buffer_slots.size());
+        memory_buffer_slots.push_back({ {}, 1, false });
     }
 
-    FileMemoryBuffer fmb = file_memory_buffers[key];
-    UnmapViewOfFile(fmb.pMemory);
-    CloseHandle(fmb.hMapFile);
-    CloseHandle(fmb.hFile);
-    std::filesystem::remove(fmb.filePath);
-    file_memory_buffers.erase(it);
+    MemoryBufferSlot& slot = memory_buffer_slots[index];
+    slot.buffer = buffer;
+    slot.used = true;
+    memory_pool_stats.live++;
+    return (static_cast<MemoryBufferHandle>(slot.generation) << 16) | index;
 }
 
-uint16_t CreateFileMemoryBuffer(size_t size)
+// expects memory_buffers_mtx to be held
+MemoryBufferSlot& LookupSlot(MemoryBufferHandle handle)
 {
-    uint16_t key = CreateFileMemoryBufferKey();
-    WF_LOG(LogLevel::LINFO, std::format("creating file memory buffer ({})", key));
+    uint16_t index = handle & 0xFFFF;
+    uint16_t generation = handle >> 16;
 
-    std::string buffer_path = GetAppDataPath(std::format("{}.dat", key));
+    if (index >= memory_buffer_slots.size() || !memory_buffer_slots[index].used || memory_buffer_slots[index].generation != generation) {
+        throw std::runtime_error(std::format("could not find memory buffer {}", handle));
+    }
+    return memory_buffer_slots[index];
+}
 
-    if (std::filesystem::exists(buffer_path)) {
-        size_t current_size = std::filesystem::file_size(buffer_path);
+// expects memory_buffers_mtx to be held
+void FreeSlot(MemoryBufferHandle handle)
+{
+    MemoryBufferSlot& slot = LookupSlot(handle);
+    slot.used = false;
+    slot.buffer = {};
+    // a stale handle to the slot no longer matches, 0 is skipped so no handle is ever 0
+    slot.generation = slot.generation == UINT16_MAX ? 1 : slot.generation + 1;
+    free_memory_buffer_slots.push_back(handle & 0xFFFF);
+    memory_pool_stats.live--;
+}
 
-        if (current_size != size) {
-            WF_LOG(LogLevel::LINFO, std::format("resizing buffer {}.dat {} -> {}", key, current_size, size));
-            std::filesystem::resize_file(buffer_path, size);
-        } else {
-            WF_LOG(LogLevel::LINFO, "buffer file does not need resizing");
-        }
-    } else {
-        WF_LOG(LogLevel::LINFO, std::format("creating buffer {}.dat {}", key, size));
+// expects memory_buffers_mtx to be held
+void UnmapIdleBuffer(size_t index)
+{
+    MemoryBuffer& buffer = idle_memory_buffers[index];
+    memory_pool_stats.idleBytes -= buffer.capacity;
+    memory_pool_stats.unmaps++;
+    GetMemoryMapper().Unmap(buffer);
+    idle_memory_buffers.erase(idle_memory_buffers.begin() + index);
+    memory_pool_stats.idle = idle_memory_buffers.size();
+}
 
-        std::ofstream file(buffer_path);
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to create output buffer file");
+MemoryBuffer MapNewBuffer(size_t size)
+{
+    MemoryMapper& mapper = GetMemoryMapper();
+    MemoryBuffer buffer = {};
+    bool large_pages = config != nullptr && config->largePages && !large_pages_failed && mapper.EnableLargePages();
+
+    if (large_pages) {
+        buffer.capacity = RoundUpTo(size, mapper.LargePageSize());
+        if (mapper.MapAnonymous(buffer, true)) {
+            buffer.largePages = true;
+            return buffer;
         }
-        file.seekp(size - 1);
-        file.put(0);
-        file.close();
+        WF_LOG(LogLevel::LWARNING, "large pages are unavailable, using regular pages");
+        large_pages_failed = true;
     }
 
-    FileMemoryBuffer fmb;
+    buffer.capacity = RoundUpTo(size, memory_buffer_granularity);
+    if (!mapper.MapAnonymous(buffer, false)) {
+        throw std::runtime_error(std::format("could not map {} bytes of memory", buffer.capacity));
+    }
+    return buffer;
+}
 
-    fmb.key = key;
-    fmb.filePath = buffer_path;
+MemoryBufferHandle AcquireMemoryBuffer(size_t size)
+{
+    std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+
+    // the smallest idle mapping that fits, as long as at least half of it gets used
+    size_t best = idle_memory_buffers.size();
+    for (size_t i = 0; i < idle_memory_buffers.size(); i++) {
+        size_t capacity = idle_memory_buffers[i].capacity;
+        if (capacity >= size && capacity / 2 <= size && (best == idle_memory_buffers.size() || capacity < idle_memory_buffers[best].capacity)) {
+            best = i;
+        }
+    }
 
-    fmb.hFile = CreateFileA(buffer_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (fmb.hFile == NULL) {
-        std::filesystem::remove(buffer_path);
-        throw std::runtime_error("could not create/open output buffer file");
+    MemoryBuffer buffer;
+    if (best < idle_memory_buffers.size()) {
+        buffer = idle_memory_buffers[best];
+        idle_memory_buffers.erase(idle_memory_buffers.begin() + best);
+        memory_pool_stats.idle = idle_memory_buffers.size();
+        memory_pool_stats.idleBytes -= buffer.capacity;
+        memory_pool_stats.reuses++;
+    } else {
+        WF_LOG(LogLevel::LINFO, "mapping memory buffer of {} bytes", size);
+        buffer = MapNewBuffer(size);
+        memory_pool_stats.maps++;
     }
 
-    fmb.hMapFile = CreateFileMappingA(fmb.hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
-    if (fmb.hMapFile == NULL) {
-        CloseHandle(fmb.hFile);
-        std::filesystem::remove(buffer_path);
-        throw std::runtime_error("could not create file mapping object for output buffer file");
+    buffer.size = size;
+    return AllocateSlot(buffer);
+}
+
+MemoryBufferHandle CreateFileMemoryBuffer(std::string path, size_t size)
+{
+    static Histogram& create_duration = GetHistogram("wallflow_file_buffer_create_duration_microseconds", "Time to create, size and map a file backed buffer");
+    static Counter& mapped_bytes = GetCounter("wallflow_file_buffer_bytes", "Bytes of file backed buffers mapped");
+
+    std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+    HistogramTimer create_timer(create_duration);
+    WF_LOG(LogLevel::LINFO, "creating file memory buffer for {}", path);
+
+    MemoryBuffer buffer = {};
+    buffer.filePath = path;
+    buffer.fileBacked = true;
+    buffer.size = size;
+    buffer.capacity = size;
+
+    GetMemoryMapper().MapFile(buffer);
+    memory_pool_stats.maps++;
+    mapped_bytes.Add(size);
+
+    return AllocateSlot(buffer);
+}
+
+MemoryBuffer GetMemoryBuffer(MemoryBufferHandle handle)
+{
+    std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+    return LookupSlot(handle).buffer;
+}
+
+void ReleaseMemoryBuffer(MemoryBufferHandle handle)
+{
+    std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+
+    MemoryBuffer buffer = LookupSlot(handle).buffer;
+    FreeSlot(handle);
+
+    if (buffer.fileBacked) {
+        WF_LOG(LogLevel::LINFO, "closing file memory buffer for {}", buffer.filePath);
+        memory_pool_stats.unmaps++;
+        GetMemoryMapper().Unmap(buffer);
+        return;
     }
 
-    fmb.pMemory = MapViewOfFile(fmb.hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    idle_memory_buffers.push_back(buffer);
+    memory_pool_stats.idle = idle_memory_buffers.size();
+    memory_pool_stats.idleBytes += buffer.capacity;
 
-    if (fmb.pMemory == NULL) {
-        CloseHandle(fmb.hMapFile);
-        CloseHandle(fmb.hFile);
-        std::filesystem::remove(buffer_path);
-        throw std::runtime_error("failed to map output buffer file into memory");
+    // the oldest go first, they belong to layouts least likely to come back
+    while (idle_memory_buffers.size() > memory_pool_idle_limit || memory_pool_stats.idleBytes > memory_pool_idle_bytes) {
+        UnmapIdleBuffer(0);
     }
+}
 
-    fmb.ptr = reinterpret_cast<uint8_t*>(fmb.pMemory);
-    fmb.ptr[0] = 0xFF;
+void TrimMemoryBufferPool()
+{
+    std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+    WF_LOG(LogLevel::LINFO, "unmapping {} idle memory buffers", idle_memory_buffers.size());
 
-    file_memory_buffers[key] = fmb;
+    while (!idle_memory_buffers.empty()) {
+        UnmapIdleBuffer(idle_memory_buffers.size() - 1);
+    }
+}
 
-    return fmb.key;
+MemoryPoolStats GetMemoryPoolStats()
+{
+    std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+    return memory_pool_stats;
 }
 
 void RemoveOldFileMemoryBuffers()
 {
+    // scratch buffers used to be files in AppData, clear out any left by older versions
     WF_LOG(LogLevel::LINFO, "deleting file memory buffer left from previous execution");
 
     for (const auto& entry : std::filesystem::directory_iterator(GetAppDataDir())) {
         if (entry.is_regular_file() && entry.path().extension() == ".dat") {
             std::filesystem::remove(entry.path());
-            WF_LOG(LogLevel::LINFO, std::format("deleted file {}", entry.path().string()));
+            WF_LOG(LogLevel::LINFO, "deleted file {}", entry.path().string());
         }
     }
 }
 
-FileMemoryBuffer GetFileMemoryBuffer(uint16_t key)
+void DeleteAllMemoryBuffers()
 {
-    WF_LOG(LogLevel::LINFO, std::format("retrieving file memory buffer ({})", key));
-
-    std::map<uint16_t, FileMemoryBuffer>::iterator it = file_memory_buffers.find(key);
-    if (it == file_memory_buffers.end()) {
-        throw std::runtime_error(std::format("could not find file memory buffer {}", key));
-    }
-    return file_memory_buffers[key];
-}
-
-void DeleteAllFileMemoryBuffers()
-{
-    WF_LOG(LogLevel::LINFO, "deleting all file memory buffers");
-
-    std::vector<uint16_t> keys;
-
-    for (const auto& pair : file_memory_buffers) {
-        keys.push_back(pair.second.key);
+    WF_LOG(LogLevel::LINFO, "deleting all memory buffers");
+
+    std::vector<MemoryBufferHandle> handles;
+    {
+        std::lock_guard<std::mutex> lock(memory_buffers_mtx);
+        for (size_t i = 0; i < memory_buffer_slots.size(); i++) {
+            if (memory_buffer_slots[i].used) {
+                handles.push_back((static_cast<MemoryBufferHandle>(memory_buffer_slots[i].generation) << 16) | i);
+            }
+        }
     }
 
-    for (const auto& key : keys) {
-        DeleteFileMemoryBuffer(key);
+    for (MemoryBufferHandle handle : handles) {
+        ReleaseMemoryBuffer(handle);
     }
+    TrimMemoryBufferPool();
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,483 @@
+#include "metadata.h"
+#include "log.h"
+#include "paths.h"
+#include "trace.h"
+#include "workers.h"
+
+#include <imageinfo.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace wallflow {
+
+const char metadata_index_magic[4] = { 'W', 'F', 'M', 'I' };
+
+// bump whenever the verification rules change so every file is probed again
+const uint32_t metadata_index_version = 2;
+
+std::unordered_map<std::string, ImageMetadata> metadata_index;
+bool metadata_index_loaded = false;
+bool metadata_index_dirty = false;
+
+// enough for the headers of nearly every png and jpeg, including exif and small icc profiles
+const size_t header_prefix_size = 64 * 1024;
+
+enum class HeaderProbe {
+    Found,
+    Unknown,
+    Truncated,
+    // a known format in a layout the decoders cannot produce BGR from
+    Unsupported
+};
+
+std::mutex metadata_index_mtx;
+
+std::string ImageMetadata::ToString()
+{
+    return std::format(
+        "ImageMetadata(size={},modifiedAt={},format={},width={},height={},verified={})",
+        size,
+        modifiedAt,
+        format,
+        width,
+        height,
+        verified);
+}
+
+std::string GetMetadataIndexPath()
+{
+    return GetAppDataPath("metadata.idx");
+}
+
+bool IsSupportedFormat(IIFormat format)
+{
+    switch (format) {
+    case II_FORMAT_PNG:
+    case II_FORMAT_JPEG:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool IsDecodableSize(uint32_t width, uint32_t height)
+{
+    // anything is resampled to its display, it only has to fit the pixel views
+    return width > 0 && height > 0 && width <= UINT16_MAX && height <= UINT16_MAX;
+}
+
+uint32_t ReadBigEndian(const uint8_t* data, size_t size)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+HeaderProbe ProbePNGHeader(const uint8_t* data, size_t size, ImageMetadata& metadata)
+{
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+    if (size < sizeof(signature) || memcmp(data, signature, sizeof(signature)) != 0) {
+        return HeaderProbe::Unknown;
+    }
+    // signature, then the IHDR chunk length and type, then width and height
+    if (size < 24) {
+        return HeaderProbe::Truncated;
+    }
+    if (memcmp(data + 12, "IHDR", 4) != 0) {
+        return HeaderProbe::Unknown;
+    }
+
+    metadata.format = II_FORMAT_PNG;
+    metadata.width = ReadBigEndian(data + 16, 4);
+    metadata.height = ReadBigEndian(data + 20, 4);
+    return HeaderProbe::Found;
+}
+
+bool IsStartOfFrameMarker(uint8_t marker)
+{
+    // C4 (huffman tables), C8 (reserved) and CC (arithmetic conditioning) share the range
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+HeaderProbe ProbeJPEGHeader(const uint8_t* data, size_t size, ImageMetadata& metadata)
+{
+    if (size < 3 || data[0] != 0xFF || data[1] != 0xD8 || data[2] != 0xFF) {
+        return HeaderProbe::Unknown;
+    }
+
+    size_t offset = 2;
+    while (true) {
+        // any number of fill bytes may precede a marker
+        while (offset < size && data[offset] == 0xFF) {
+            offset++;
+        }
+        if (offset >= size) {
+            return HeaderProbe::Truncated;
+        }
+
+        uint8_t marker = data[offset++];
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA || marker == 0x00) {
+            // end of image or scan data before any frame header
+            return HeaderProbe::Unknown;
+        }
+
+        if (size - offset < 2) {
+            return HeaderProbe::Truncated;
+        }
+        uint32_t length = ReadBigEndian(data + offset, 2);
+        if (length < 2) {
+            return HeaderProbe::Unknown;
+        }
+
+        if (IsStartOfFrameMarker(marker)) {
+            // length, precision, height before width, then the component count
+            if (size - offset < 8) {
+                return HeaderProbe::Truncated;
+            }
+            metadata.format = II_FORMAT_JPEG;
+            metadata.height = ReadBigEndian(data + offset + 3, 2);
+            metadata.width = ReadBigEndian(data + offset + 5, 2);
+
+            // CMYK and YCCK frames have four, libjpeg-turbo will not convert those to BGR
+            uint8_t components = data[offset + 7];
+            if (components != 1 && components != 3) {
+                return HeaderProbe::Unsupported;
+            }
+            return HeaderProbe::Found;
+        }
+
+        offset += length;
+    }
+}
+
+#ifdef _WIN32
+
+bool ReadFilePrefix(const std::string& path, std::vector<uint8_t>& buffer)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // one positional read from the start, a remote share sees a single request
+    OVERLAPPED overlapped = {};
+    DWORD bytes_read = 0;
+    buffer.resize(header_prefix_size);
+    BOOL success = ReadFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &bytes_read, &overlapped);
+    CloseHandle(file);
+
+    if (!success && GetLastError() != ERROR_HANDLE_EOF) {
+        return false;
+    }
+    buffer.resize(bytes_read);
+    return true;
+}
+
+#else
+
+bool ReadFilePrefix(const std::string& path, std::vector<uint8_t>& buffer)
+{
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return false;
+    }
+
+    // one positional read from the start, a remote share sees a single request
+    buffer.resize(header_prefix_size);
+    ssize_t bytes_read = pread(descriptor, buffer.data(), buffer.size(), 0);
+    close(descriptor);
+
+    if (bytes_read < 0) {
+        return false;
+    }
+    buffer.resize(static_cast<size_t>(bytes_read));
+    return true;
+}
+
+#endif
+
+HeaderProbe ProbeImageHeader(const std::string& path, ImageMetadata& metadata)
+{
+    std::vector<uint8_t> buffer;
+    if (!ReadFilePrefix(path, buffer)) {
+        return HeaderProbe::Truncated;
+    }
+
+    HeaderProbe probe = ProbePNGHeader(buffer.data(), buffer.size(), metadata);
+    if (probe != HeaderProbe::Unknown) {
+        return probe;
+    }
+    return ProbeJPEGHeader(buffer.data(), buffer.size(), metadata);
+}
+
+void ProbeImageMetadata(const std::string& path, ImageMetadata& metadata)
+{
+    WF_LOG(LogLevel::LINFO, "probing image {}", path);
+
+    metadata.format = II_FORMAT_UNKNOWN;
+    metadata.width = 0;
+    metadata.height = 0;
+    metadata.verified = false;
+
+    HeaderProbe probe = ProbeImageHeader(path, metadata);
+    if (probe == HeaderProbe::Truncated) {
+        // headers past the prefix (huge app segments) or an unreadable file, let imageinfo have a go
+        WF_LOG(LogLevel::LINFO, "image {} header not in prefix, reading it whole", path);
+        ImageInfo info = getImageInfo<IIFilePathReader>(path);
+        metadata.format = static_cast<int32_t>(info.getFormat());
+        metadata.width = static_cast<uint32_t>(info.getWidth());
+        metadata.height = static_cast<uint32_t>(info.getHeight());
+    }
+
+    if (probe == HeaderProbe::Unsupported || !IsSupportedFormat(static_cast<IIFormat>(metadata.format))) {
+        WF_LOG(LogLevel::LWARNING, "image ({}) unsupported format", path);
+        return;
+    }
+
+    if (!IsDecodableSize(metadata.width, metadata.height)) {
+        WF_LOG(LogLevel::LWARNING, "image ({}) invalid size", path);
+        return;
+    }
+
+    metadata.verified = true;
+}
+
+template <typename T>
+void WriteIndexValue(std::ofstream& out_file, T value)
+{
+    out_file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool ReadIndexValue(const std::vector<char>& data, size_t& offset, T& value)
+{
+    if (data.size() - offset < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, data.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+bool ParseMetadataIndex(const std::vector<char>& data)
+{
+    size_t offset = 0;
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+
+    if (!ReadIndexValue(data, offset, magic) || memcmp(magic, metadata_index_magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    if (!ReadIndexValue(data, offset, version) || version != metadata_index_version) {
+        return false;
+    }
+    if (!ReadIndexValue(data, offset, count)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t path_size;
+        if (!ReadIndexValue(data, offset, path_size) || data.size() - offset < path_size) {
+            return false;
+        }
+        std::string path(data.data() + offset, path_size);
+        offset += path_size;
+
+        ImageMetadata metadata;
+        uint8_t verified;
+        if (!ReadIndexValue(data, offset, metadata.size)
+            || !ReadIndexValue(data, offset, metadata.modifiedAt)
+            || !ReadIndexValue(data, offset, metadata.format)
+            || !ReadIndexValue(data, offset, metadata.width)
+            || !ReadIndexValue(data, offset, metadata.height)
+            || !ReadIndexValue(data, offset, verified)) {
+            return false;
+        }
+        metadata.verified = verified != 0;
+        metadata_index[path] = metadata;
+    }
+    return true;
+}
+
+// expects metadata_index_mtx to be held
+void LoadMetadataIndex()
+{
+    if (metadata_index_loaded) {
+        return;
+    }
+    metadata_index_loaded = true;
+
+    WF_LOG(LogLevel::LINFO, "loading metadata index");
+    WF_TRACE_SCOPE("LoadMetadataIndex");
+
+    std::ifstream in_file(GetMetadataIndexPath(), std::ios::binary);
+    if (!in_file.is_open()) {
+        WF_LOG(LogLevel::LINFO, "no metadata index found");
+        return;
+    }
+
+    std::vector<char> data((std::istreambuf_iterator<char>(in_file)), std::istreambuf_iterator<char>());
+
+    if (!ParseMetadataIndex(data)) {
+        // a stale or damaged index only costs a full probe, never fail on it
+        WF_LOG(LogLevel::LWARNING, "metadata index is unreadable, discarding it");
+        metadata_index.clear();
+        metadata_index_dirty = true;
+    }
+
+    WF_LOG(LogLevel::LINFO, "loaded metadata for {} images", metadata_index.size());
+}
+
+bool GetImageMetadata(const std::string& path, ImageMetadata& metadata)
+{
+    std::error_code ec;
+    std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(metadata_index_mtx);
+        LoadMetadataIndex();
+
+        auto it = metadata_index.find(path);
+        if (it != metadata_index.end() && it->second.size == size && it->second.modifiedAt == modified_at.time_since_epoch().count()) {
+            metadata = it->second;
+            return true;
+        }
+    }
+
+    metadata.size = size;
+    metadata.modifiedAt = modified_at.time_since_epoch().count();
+    ProbeImageMetadata(path, metadata);
+
+    std::lock_guard<std::mutex> lock(metadata_index_mtx);
+    metadata_index[path] = metadata;
+    metadata_index_dirty = true;
+    return true;
+}
+
+std::vector<std::optional<ImageMetadata>> GetImagesMetadata(const std::vector<std::string>& paths)
+{
+    WF_TRACE_SCOPE("GetImagesMetadata");
+
+    // probing is latency bound on slow disks and shares, so keep several reads in flight
+    std::vector<std::optional<ImageMetadata>> result(paths.size());
+    RunParallel(paths.size(), [&](size_t i) {
+        ImageMetadata metadata;
+        if (GetImageMetadata(paths[i], metadata)) {
+            result[i] = metadata;
+        }
+    });
+
+    return result;
+}
+
+void RemoveImageMetadata(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(metadata_index_mtx);
+    LoadMetadataIndex();
+
+    if (metadata_index.erase(path) > 0) {
+        metadata_index_dirty = true;
+    }
+}
+
+void PruneImageMetadata(const std::string& dir_path, const std::vector<std::string>& files)
+{
+    std::lock_guard<std::mutex> lock(metadata_index_mtx);
+    LoadMetadataIndex();
+
+    std::unordered_set<std::string> present(files.begin(), files.end());
+    // everything below the directory, the repos are walked recursively
+    std::string prefix = (std::filesystem::path(dir_path) / "").string();
+
+    for (auto it = metadata_index.begin(); it != metadata_index.end();) {
+        if (it->first.starts_with(prefix) && present.find(it->first) == present.end()) {
+            WF_LOG(LogLevel::LINFO, "dropping metadata of removed image {}", it->first);
+            it = metadata_index.erase(it);
+            metadata_index_dirty = true;
+        } else {
+            it++;
+        }
+    }
+}
+
+void SaveMetadataIndex()
+{
+    std::lock_guard<std::mutex> lock(metadata_index_mtx);
+
+    if (!metadata_index_dirty) {
+        return;
+    }
+
+    WF_LOG(LogLevel::LINFO, "saving metadata index");
+    WF_TRACE_SCOPE("SaveMetadataIndex");
+
+    // written aside and renamed so a crash mid-write leaves the old index intact
+    std::string index_path = GetMetadataIndexPath();
+    std::string temp_path = index_path + ".tmp";
+
+    std::ofstream out_file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out_file.is_open()) {
+        WF_LOG(LogLevel::LWARNING, "could not open metadata index to write");
+        return;
+    }
+
+    out_file.write(metadata_index_magic, sizeof(metadata_index_magic));
+    WriteIndexValue(out_file, metadata_index_version);
+    WriteIndexValue(out_file, static_cast<uint64_t>(metadata_index.size()));
+
+    for (const auto& pair : metadata_index) {
+        const ImageMetadata& metadata = pair.second;
+        WriteIndexValue(out_file, static_cast<uint32_t>(pair.first.size()));
+        out_file.write(pair.first.data(), pair.first.size());
+        WriteIndexValue(out_file, metadata.size);
+        WriteIndexValue(out_file, metadata.modifiedAt);
+        WriteIndexValue(out_file, metadata.format);
+        WriteIndexValue(out_file, metadata.width);
+        WriteIndexValue(out_file, metadata.height);
+        WriteIndexValue(out_file, static_cast<uint8_t>(metadata.verified ? 1 : 0));
+    }
+    out_file.close();
+
+    std::error_code ec;
+    if (!out_file) {
+        std::filesystem::remove(temp_path, ec);
+        WF_LOG(LogLevel::LWARNING, "could not write metadata index");
+        return;
+    }
+
+    std::filesystem::rename(temp_path, index_path, ec);
+    if (ec) {
+        WF_LOG(LogLevel::LWARNING, "could not replace metadata index: {}", ec.message());
+        return;
+    }
+    metadata_index_dirty = false;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "metrics.h"
+#include "log.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace wallflow {
+
+size_t Histogram::GetBucket(uint64_t value)
+{
+    const uint64_t sub_buckets = uint64_t(1) << sub_bucket_bits;
+    if (value < sub_buckets) {
+        return static_cast<size_t>(value);
+    }
+
+    // the top sub_bucket_bits + 1 bits pick the bucket within the power of two
+    int shift = std::bit_width(value) - 1 - sub_bucket_bits;
+    return static_cast<size_t>((shift + 1) * sub_buckets + ((value >> shift) - sub_buckets));
+}
+
+uint64_t Histogram::GetBucketUpperBound(size_t bucket)
+{
+    const uint64_t sub_buckets = uint64_t(1) << sub_bucket_bits;
+    if (bucket < sub_buckets) {
+        return bucket;
+    }
+
+    int shift = static_cast<int>(bucket / sub_buckets) - 1;
+    uint64_t top = bucket % sub_buckets + sub_buckets;
+    return ((top + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64_t value)
+{
+    buckets[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::Count() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Sum() const
+{
+    return sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Max() const
+{
+    return max.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Percentile(double percentile) const
+{
+    // the buckets themselves are the total, count may run ahead of them while recording
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t>& bucket : buckets) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(GetBucketUpperBound(i), Max());
+        }
+    }
+    return Max();
+}
+
+enum class MetricType {
+    Counter,
+    Gauge,
+    Histogram
+};
+
+struct MetricFamily {
+    MetricType type;
+    std::string help;
+    // labels to series, only the map of the family type is used
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+};
+
+std::map<std::string, MetricFamily> metric_families;
+
+std::mutex metrics_mtx;
+
+// expects metrics_mtx to be held
+MetricFamily& GetMetricFamily(const std::string& name, const std::string& help, MetricType type)
+{
+    auto [it, inserted] = metric_families.try_emplace(name);
+    if (inserted) {
+        it->second.type = type;
+        it->second.help = help;
+    } else if (it->second.type != type) {
+        throw std::runtime_error(std::format("metric {} is already registered with another type", name));
+    }
+    return it->second;
+}
+
+// expects metrics_mtx to be held
+template <typename T>
+T& GetMetricSeries(std::map<std::string, std::unique_ptr<T>>& series, const std::string& labels)
+{
+    std::unique_ptr<T>& metric = series[labels];
+    if (!metric) {
+        metric = std::make_unique<T>();
+    }
+    return *metric;
+}
+
+Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(metrics_mtx);
+    return GetMetricSeries(GetMetricFamily(name, help, MetricType::Counter).counters, labels);
+}
+
+Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(metrics_mtx);
+    return GetMetricSeries(GetMetricFamily(name, help, MetricType::Gauge).gauges, labels);
+}
+
+Histogram& GetHistogram(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(metrics_mtx);
+    return GetMetricSeries(GetMetricFamily(name, help, MetricType::Histogram).histograms, labels);
+}
+
+std::string FormatMetricLabels(const std::string& labels, const std::string& extra = "")
+{
+    if (labels.empty() && extra.empty()) {
+        return "";
+    }
+    if (labels.empty() || extra.empty()) {
+        return std::format("{{{}}}", labels.empty() ? extra : labels);
+    }
+    return std::format("{{{},{}}}", labels, extra);
+}
+
+struct MetricQuantile {
+    const char* label;
+    double percentile;
+};
+
+const MetricQuantile metric_quantiles[] = { { "0.5", 50 }, { "0.9", 90 }, { "0.99", 99 } };
+
+std::string GetMetricsText()
+{
+    std::lock_guard<std::mutex> lock(metrics_mtx);
+    std::string out;
+    auto it = std::back_inserter(out);
+
+    for (const auto& [name, family] : metric_families) {
+        const char* type = family.type == MetricType::Counter ? "counter" : family.type == MetricType::Gauge ? "gauge" : "summary";
+        std::format_to(it, "# TYPE {} {}\n# HELP {} {}\n", name, type, name, family.help);
+
+        for (const auto& [labels, counter] : family.counters) {
+            std::format_to(it, "{}_total{} {}\n", name, FormatMetricLabels(labels), counter->Get());
+        }
+        for (const auto& [labels, gauge] : family.gauges) {
+            std::format_to(it, "{}{} {}\n", name, FormatMetricLabels(labels), gauge->Get());
+        }
+        for (const auto& [labels, histogram] : family.histograms) {
+            for (const MetricQuantile& quantile : metric_quantiles) {
+                std::string quantile_label = std::format("quantile=\"{}\"", quantile.label);
+                std::format_to(it, "{}{} {}\n", name, FormatMetricLabels(labels, quantile_label), histogram->Percentile(quantile.percentile));
+            }
+            std::format_to(it, "{}{} {}\n", name, FormatMetricLabels(labels, "quantile=\"1\""), histogram->Max());
+            std::format_to(it, "{}_sum{} {}\n", name, FormatMetricLabels(labels), histogram->Sum());
+            std::format_to(it, "{}_count{} {}\n", name, FormatMetricLabels(labels), histogram->Count());
+        }
+    }
+
+    out += "# EOF\n";
+    return out;
+}
+
+std::string GetMetricsSummary()
+{
+    std::lock_guard<std::mutex> lock(metrics_mtx);
+    std::string out;
+    auto it = std::back_inserter(out);
+
+    for (const auto& [name, family] : metric_families) {
+        std::string short_name = name.starts_with("wallflow_") ? name.substr(9) : name;
+
+        for (const auto& [labels, counter] : family.counters) {
+            std::format_to(it, "{}{}: {}\n", short_name, FormatMetricLabels(labels), counter->Get());
+        }
+        for (const auto& [labels, gauge] : family.gauges) {
+            std::format_to(it, "{}{}: {}\n", short_name, FormatMetricLabels(labels), gauge->Get());
+        }
+        for (const auto& [labels, histogram] : family.histograms) {
+            if (histogram->Count() == 0) {
+                continue;
+            }
+            std::format_to(
+                it,
+                "{}{}: n={} p50={} p99={} max={}\n",
+                short_name,
+                FormatMetricLabels(labels),
+                histogram->Count(),
+                histogram->Percentile(50),
+                histogram->Percentile(99),
+                histogram->Max());
+        }
+    }
+    return out;
+}
+
+void WriteMetrics(const std::string& path)
+{
+    std::string text = GetMetricsText();
+
+    // readers never see a half written file
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out_file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out_file.is_open()) {
+            throw std::runtime_error(std::format("could not open metrics file ({})", tmp_path));
+        }
+        out_file.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (!out_file) {
+            throw std::runtime_error(std::format("could not write metrics file ({})", tmp_path));
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        throw std::runtime_error(std::format("could not replace metrics file ({}): {}", path, ec.message()));
+    }
+}
+
+std::thread metrics_writer;
+std::string metrics_writer_path;
+bool metrics_writer_stopping = false;
+std::condition_variable metrics_writer_cv;
+
+std::mutex metrics_writer_mtx;
+
+void RunMetricsWriter(std::string path, std::chrono::seconds interval)
+{
+    SetTraceThreadName("metrics");
+    std::unique_lock<std::mutex> lock(metrics_writer_mtx);
+
+    // one last dump goes out when stopping
+    bool stopping = false;
+    while (!stopping) {
+        stopping = metrics_writer_cv.wait_for(lock, interval, [] { return metrics_writer_stopping; });
+        lock.unlock();
+
+        try {
+            WriteMetrics(path);
+        } catch (const std::exception& ex) {
+            WF_LOG(LogLevel::LWARNING, ex.what());
+        }
+
+        lock.lock();
+    }
+}
+
+void StartMetricsWriter(const std::string& path, unsigned int interval)
+{
+    std::lock_guard<std::mutex> lock(metrics_writer_mtx);
+    if (metrics_writer.joinable()) {
+        return;
+    }
+
+    metrics_writer_path = path;
+    // without an interval nothing wakes up while idle, the metrics are only written on the way out
+    if (interval == 0) {
+        WF_LOG(LogLevel::LINFO, "writing metrics to {} on exit", path);
+        return;
+    }
+
+    WF_LOG(LogLevel::LINFO, "writing metrics to {} every {}s", path, interval);
+    metrics_writer_stopping = false;
+    metrics_writer = std::thread(RunMetricsWriter, path, std::chrono::seconds(interval));
+}
+
+void StopMetricsWriter()
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(metrics_writer_mtx);
+        metrics_writer_stopping = true;
+        path = std::move(metrics_writer_path);
+        metrics_writer_path.clear();
+    }
+    metrics_writer_cv.notify_all();
+
+    // a running writer does the last dump itself
+    if (metrics_writer.joinable()) {
+        metrics_writer.join();
+        return;
+    }
+    if (!path.empty()) {
+        try {
+            WriteMetrics(path);
+        } catch (const std::exception& ex) {
+            WF_LOG(LogLevel::LWARNING, ex.what());
+        }
+    }
+}
+
+}
\ No newline at end of file
@@ -1,46 +1,48 @@
 #include "paths.h"
 #include "convert.h"
 #include "log.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <filesystem>
 #include <format>
 #include <iostream>
 #include <sstream>
 
+#ifdef _WIN32
 #include <shlobj.h>
 #include <windows.h>
+#endif
 
 namespace wallflow {
 
+// set by tools that must not touch the data of the installed app
+std::string app_data_dir_override;
+
 void CreateAppDataDir()
 {
     WF_LOG(LogLevel::LINFO, "creating AppData directory");
-    WF_START_TIMER("CreateAppDataDir()");
+    WF_TRACE_SCOPE("CreateAppDataDir");
 
-    try {
-        std::string dir_path = GetAppDataDir();
+    std::string dir_path = GetAppDataDir();
 
-        if (std::filesystem::exists(dir_path)) {
-            if (!std::filesystem::is_directory(dir_path)) {
-                throw std::runtime_error("expected AppData path to be directory, it is not.");
-            }
-            WF_END_TIMER("CreateAppDataDir()");
-            return;
+    if (std::filesystem::exists(dir_path)) {
+        if (!std::filesystem::is_directory(dir_path)) {
+            throw std::runtime_error("expected AppData path to be directory, it is not.");
         }
-
-        if (!std::filesystem::create_directory(dir_path)) {
-            throw std::exception("could not create AppData directory");
-        }
-
-    } catch (const std::exception& ex) {
-        WF_END_TIMER("CreateAppDataDir()");
-        throw;
+        return;
     }
 
-    WF_END_TIMER("CreateAppDataDir()");
+    if (!std::filesystem::create_directories(dir_path)) {
+        throw std::runtime_error("could not create AppData directory");
+    }
 }
 
-std::string GetAppDataDir()
+#ifdef _WIN32
+
+std::string GetDefaultAppDataDir()
 {
     PWSTR pszPath = nullptr;
     if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, nullptr, &pszPath))) {
@@ -55,11 +57,40 @@ std::string GetAppDataDir()
     throw std::runtime_error("could not create AppData directory");
 }
 
+#else
+
+std::string GetDefaultAppDataDir()
+{
+    // the XDG counterpart of LocalAppData
+    const char* data_home = std::getenv("XDG_DATA_HOME");
+    if (data_home != nullptr && data_home[0] != '\0') {
+        return (std::filesystem::path(data_home) / APP_DATA_DIR).string();
+    }
+    return (std::filesystem::path(GetUserDir()) / ".local" / "share" / APP_DATA_DIR).string();
+}
+
+#endif
+
+void SetAppDataDir(const std::string& dir_path)
+{
+    app_data_dir_override = dir_path;
+}
+
+std::string GetAppDataDir()
+{
+    if (!app_data_dir_override.empty()) {
+        return app_data_dir_override;
+    }
+    return GetDefaultAppDataDir();
+}
+
 std::string GetAppDataPath(std::string path)
 {
-    return std::format("{}\\{}", GetAppDataDir(), path);
+    return (std::filesystem::path(GetAppDataDir()) / path).string();
 }
 
+#ifdef _WIN32
+
 std::string GetUserDir()
 {
     wchar_t user_wpath[MAX_PATH];
@@ -71,11 +102,26 @@ std::string GetUserDir()
     return WStringToString(ws);
 }
 
+#else
+
+std::string GetUserDir()
+{
+    const char* home = std::getenv("HOME");
+    if (home == nullptr || home[0] == '\0') {
+        throw std::runtime_error("could not get users home directory");
+    }
+    return home;
+}
+
+#endif
+
 std::string GetUserPath(std::string path)
 {
-    return std::format("{}\\{}", GetUserDir(), path);
+    return (std::filesystem::path(GetUserDir()) / path).string();
 }
 
+#ifdef _WIN32
+
 std::string SelectDirectoryDialog()
 {
     CoInitialize(NULL);
@@ -116,24 +162,32 @@ std::string SelectDirectoryDialog()
     return WStringToString(selected_dir);
 }
 
-std::vector<std::string> GetFilesWithExtensions(const std::string& dir_path, const std::vector<std::string>& extensions)
+#else
+
+std::string SelectDirectoryDialog()
 {
-    std::vector<std::string> files;
+    // there is no folder picker to show, the directory has to be set in the config
+    WF_LOG(LogLevel::LWARNING, "selecting a directory is not supported on this platform");
+    return "";
+}
 
-    for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
-        if (!entry.is_regular_file()) {
+#endif
+
+// cameras and most Windows tools write upper case extensions (.JPG)
+bool HasExtension(const std::string& path, const std::vector<std::string>& extensions)
+{
+    for (const std::string& ext : extensions) {
+        if (path.size() <= ext.size() || path[path.size() - ext.size() - 1] != '.') {
             continue;
         }
-        std::string file_path = entry.path().string();
-        for (const std::string& ext : extensions) {
-            if (file_path.ends_with("." + ext)) {
-                files.push_back(file_path);
-                break;
-            }
+        bool match = std::equal(ext.begin(), ext.end(), path.end() - ext.size(), [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        });
+        if (match) {
+            return true;
         }
     }
-
-    return files;
+    return false;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "platform.h"
+#include "log.h"
+
+#include <filesystem>
+#include <format>
+#include <mutex>
+
+namespace wallflow {
+
+namespace {
+
+class StaticDisplaySource : public DisplaySource {
+public:
+    StaticDisplaySource(std::vector<Display> layout)
+        : layout(std::move(layout))
+    {
+    }
+
+    const char* Name() const override { return "static"; }
+
+    bool Enumerate(std::vector<Display>& found) override
+    {
+        found.insert(found.end(), layout.begin(), layout.end());
+        return !layout.empty();
+    }
+
+private:
+    std::vector<Display> layout;
+};
+
+class FileWallpaperTarget : public WallpaperTarget {
+public:
+    FileWallpaperTarget(std::string output_path)
+        : outputPath(std::move(output_path))
+    {
+    }
+
+    const char* Name() const override { return "file"; }
+
+    void Apply(const std::string& path) override
+    {
+        std::filesystem::path output_path(outputPath);
+        if (output_path.has_parent_path()) {
+            std::filesystem::create_directories(output_path.parent_path());
+        }
+
+        // the encoded file stays where it is, it is overwritten by the next cycle
+        std::filesystem::copy_file(path, output_path, std::filesystem::copy_options::overwrite_existing);
+        WF_LOG(LogLevel::LINFO, "wrote wallpaper to {}", outputPath);
+    }
+
+private:
+    std::string outputPath;
+};
+
+}
+
+std::unique_ptr<DisplaySource> CreateStaticDisplaySource(std::vector<Display> layout)
+{
+    return std::make_unique<StaticDisplaySource>(std::move(layout));
+}
+
+std::unique_ptr<WallpaperTarget> CreateFileWallpaperTarget(std::string output_path)
+{
+    return std::make_unique<FileWallpaperTarget>(std::move(output_path));
+}
+
+std::unique_ptr<DisplaySource> display_source;
+std::unique_ptr<WallpaperTarget> wallpaper_target;
+std::mutex platform_mtx;
+
+DisplaySource& GetDisplaySource()
+{
+    std::lock_guard<std::mutex> lock(platform_mtx);
+    if (!display_source) {
+        display_source = CreateNativeDisplaySource();
+    }
+    return *display_source;
+}
+
+void SetDisplaySource(std::unique_ptr<DisplaySource> source)
+{
+    std::lock_guard<std::mutex> lock(platform_mtx);
+    WF_LOG(LogLevel::LINFO, "using {} display source", source->Name());
+    display_source = std::move(source);
+}
+
+WallpaperTarget& GetWallpaperTarget()
+{
+    std::lock_guard<std::mutex> lock(platform_mtx);
+    if (!wallpaper_target) {
+        wallpaper_target = CreateNativeWallpaperTarget();
+    }
+    return *wallpaper_target;
+}
+
+void SetWallpaperTarget(std::unique_ptr<WallpaperTarget> target)
+{
+    std::lock_guard<std::mutex> lock(platform_mtx);
+    WF_LOG(LogLevel::LINFO, "using {} wallpaper target", target->Name());
+    wallpaper_target = std::move(target);
+}
+
+MemoryMapper& GetMemoryMapper()
+{
+    // mappings outlive any replacement, so this one is fixed for the process
+    static std::unique_ptr<MemoryMapper> mapper = CreateNativeMemoryMapper();
+    return *mapper;
+}
+
+}
\ No newline at end of file
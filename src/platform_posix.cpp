@@ -0,0 +1,123 @@
+#include "platform.h"
+
+#ifndef _WIN32
+
+#include <format>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace wallflow {
+
+namespace {
+
+class PosixDisplaySource : public DisplaySource {
+public:
+    const char* Name() const override { return "posix"; }
+
+    bool Enumerate(std::vector<Display>&) override
+    {
+        // nothing to enumerate without a Windows desktop, layouts come from a static source
+        return false;
+    }
+};
+
+class PosixWallpaperTarget : public WallpaperTarget {
+public:
+    const char* Name() const override { return "posix"; }
+
+    void Apply(const std::string& path) override
+    {
+        throw std::runtime_error(std::format("setting the wallpaper ({}) is not supported on this platform", path));
+    }
+};
+
+class PosixMemoryMapper : public MemoryMapper {
+public:
+    const char* Name() const override { return "posix"; }
+
+    bool EnableLargePages() override
+    {
+        // MFD_HUGETLB fails by itself when no huge pages are reserved
+        return true;
+    }
+
+    size_t LargePageSize() const override
+    {
+        return 2 * 1024 * 1024;
+    }
+
+    bool MapAnonymous(MemoryBuffer& buffer, bool large_pages) override
+    {
+        int fd = memfd_create("wallflow-buffer", MFD_CLOEXEC | (large_pages ? MFD_HUGETLB : 0));
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, static_cast<off_t>(buffer.capacity)) != 0) {
+            close(fd);
+            return false;
+        }
+
+        void* ptr = mmap(NULL, buffer.capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+
+        buffer.ptr = static_cast<uint8_t*>(ptr);
+        buffer.nativeFile = fd;
+        buffer.nativeMapping = -1;
+        return true;
+    }
+
+    void MapFile(MemoryBuffer& buffer) override
+    {
+        int fd = open(buffer.filePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("could not create/open output buffer file");
+        }
+        if (ftruncate(fd, static_cast<off_t>(buffer.size)) != 0) {
+            close(fd);
+            throw std::runtime_error("could not size output buffer file");
+        }
+
+        void* ptr = mmap(NULL, buffer.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("failed to map output buffer file into memory");
+        }
+
+        buffer.ptr = static_cast<uint8_t*>(ptr);
+        buffer.nativeFile = fd;
+        buffer.nativeMapping = -1;
+    }
+
+    void Unmap(MemoryBuffer& buffer) override
+    {
+        munmap(buffer.ptr, buffer.capacity);
+        close(static_cast<int>(buffer.nativeFile));
+    }
+};
+
+}
+
+std::unique_ptr<DisplaySource> CreateNativeDisplaySource()
+{
+    return std::make_unique<PosixDisplaySource>();
+}
+
+std::unique_ptr<WallpaperTarget> CreateNativeWallpaperTarget()
+{
+    return std::make_unique<PosixWallpaperTarget>();
+}
+
+std::unique_ptr<MemoryMapper> CreateNativeMemoryMapper()
+{
+    return std::make_unique<PosixMemoryMapper>();
+}
+
+}
+
+#endif
\ No newline at end of file
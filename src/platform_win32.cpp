@@ -0,0 +1,215 @@
+#include "platform.h"
+
+#ifdef _WIN32
+
+#include "config.h"
+#include "convert.h"
+
+#include <format>
+#include <stdexcept>
+
+#define NOMINMAX
+
+#include <windows.h>
+
+namespace wallflow {
+
+namespace {
+
+BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
+{
+    std::vector<Display>& found = *reinterpret_cast<std::vector<Display>*>(dwData);
+
+    MONITORINFOEX monitor_info;
+    monitor_info.cbSize = sizeof(MONITORINFOEX);
+
+    if (GetMonitorInfo(hMonitor, &monitor_info)) {
+
+        Display display;
+
+        std::wstring wid;
+        for (int i = 0; i < 32 && monitor_info.szDevice[i] != L'\0'; ++i) {
+            wid += monitor_info.szDevice[i];
+        }
+
+        RECT rect = monitor_info.rcMonitor;
+
+        display.x = rect.left;
+        display.y = rect.top;
+
+        display.width = rect.right - rect.left;
+        display.height = rect.bottom - rect.top;
+
+        std::string repo_key = std::format("{}x{}", display.width, display.height);
+        display.id = std::format("{}:{}", WStringToString(wid), repo_key);
+        display.repoKey = repo_key;
+        display.alias = GetOrCreateAlias(display.id, repo_key);
+
+        found.push_back(display);
+    }
+
+    return TRUE;
+}
+
+class Win32DisplaySource : public DisplaySource {
+public:
+    const char* Name() const override { return "win32"; }
+
+    bool Enumerate(std::vector<Display>& found) override
+    {
+        return EnumDisplayMonitors(NULL, NULL, MonitorEnumProc, reinterpret_cast<LPARAM>(&found));
+    }
+};
+
+class Win32WallpaperTarget : public WallpaperTarget {
+public:
+    const char* Name() const override { return "win32"; }
+
+    void Apply(const std::string& path) override
+    {
+        SetWallpaperStyleToSpan();
+
+        std::string wallpaper_path = path;
+        if (!SystemParametersInfoW(SPI_SETDESKWALLPAPER, 0, const_cast<wchar_t*>(StringToWString(wallpaper_path).c_str()), SPIF_UPDATEINIFILE)) {
+            throw std::runtime_error("could not apply wallpaper");
+        }
+    }
+
+private:
+    void SetWallpaperStyleToSpan()
+    {
+        HKEY hKey;
+        if (RegOpenKeyExW(HKEY_CURRENT_USER, L"Control Panel\\Desktop", 0, KEY_WRITE, &hKey) != ERROR_SUCCESS) {
+            throw std::runtime_error("could not change wallpaper fit to span");
+        }
+
+        const wchar_t* wallpaperStyleValue = L"22";
+        RegSetValueExW(hKey, L"WallpaperStyle", 0, REG_SZ, (const BYTE*)wallpaperStyleValue, sizeof(wchar_t) * (wcslen(wallpaperStyleValue) + 1));
+        RegCloseKey(hKey);
+    }
+};
+
+HANDLE GetFileHandle(const MemoryBuffer& buffer)
+{
+    return reinterpret_cast<HANDLE>(buffer.nativeFile);
+}
+
+HANDLE GetMappingHandle(const MemoryBuffer& buffer)
+{
+    return reinterpret_cast<HANDLE>(buffer.nativeMapping);
+}
+
+class Win32MemoryMapper : public MemoryMapper {
+public:
+    const char* Name() const override { return "win32"; }
+
+    bool EnableLargePages() override
+    {
+        static bool enabled = [] {
+            // large pages need SeLockMemoryPrivilege, which has to be granted to the user first
+            HANDLE token;
+            if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+                return false;
+            }
+
+            TOKEN_PRIVILEGES privileges = {};
+            privileges.PrivilegeCount = 1;
+            privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+            bool success = LookupPrivilegeValueW(NULL, L"SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+                && AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL)
+                && GetLastError() == ERROR_SUCCESS;
+            CloseHandle(token);
+            return success;
+        }();
+        return enabled && GetLargePageMinimum() > 0;
+    }
+
+    size_t LargePageSize() const override
+    {
+        return GetLargePageMinimum();
+    }
+
+    bool MapAnonymous(MemoryBuffer& buffer, bool large_pages) override
+    {
+        // backed by the pagefile, nothing is written anywhere unless memory runs short
+        DWORD protect = PAGE_READWRITE | SEC_COMMIT | (large_pages ? SEC_LARGE_PAGES : 0);
+        HANDLE hMapFile = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, protect, static_cast<DWORD>(static_cast<uint64_t>(buffer.capacity) >> 32), static_cast<DWORD>(buffer.capacity & 0xFFFFFFFF), NULL);
+        if (hMapFile == NULL) {
+            return false;
+        }
+
+        DWORD access = FILE_MAP_ALL_ACCESS | (large_pages ? FILE_MAP_LARGE_PAGES : 0);
+        buffer.ptr = reinterpret_cast<uint8_t*>(MapViewOfFile(hMapFile, access, 0, 0, 0));
+        if (buffer.ptr == NULL) {
+            CloseHandle(hMapFile);
+            return false;
+        }
+
+        buffer.nativeFile = reinterpret_cast<intptr_t>(INVALID_HANDLE_VALUE);
+        buffer.nativeMapping = reinterpret_cast<intptr_t>(hMapFile);
+        return true;
+    }
+
+    void MapFile(MemoryBuffer& buffer) override
+    {
+        // persistent buffers are read by other processes (the wallpaper engine) while mapped
+        HANDLE hFile = CreateFileA(buffer.filePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("could not create/open output buffer file");
+        }
+
+        // grows or shrinks the file in place, a larger canvas from an earlier layout leaves no tail
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(buffer.size);
+        if (!SetFilePointerEx(hFile, position, NULL, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+            CloseHandle(hFile);
+            throw std::runtime_error("could not size output buffer file");
+        }
+
+        HANDLE hMapFile = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+        if (hMapFile == NULL) {
+            CloseHandle(hFile);
+            throw std::runtime_error("could not create file mapping object for output buffer file");
+        }
+
+        buffer.ptr = reinterpret_cast<uint8_t*>(MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        if (buffer.ptr == NULL) {
+            CloseHandle(hMapFile);
+            CloseHandle(hFile);
+            throw std::runtime_error("failed to map output buffer file into memory");
+        }
+
+        buffer.nativeFile = reinterpret_cast<intptr_t>(hFile);
+        buffer.nativeMapping = reinterpret_cast<intptr_t>(hMapFile);
+    }
+
+    void Unmap(MemoryBuffer& buffer) override
+    {
+        UnmapViewOfFile(buffer.ptr);
+        CloseHandle(GetMappingHandle(buffer));
+        if (buffer.fileBacked) {
+            CloseHandle(GetFileHandle(buffer));
+        }
+    }
+};
+
+}
+
+std::unique_ptr<DisplaySource> CreateNativeDisplaySource()
+{
+    return std::make_unique<Win32DisplaySource>();
+}
+
+std::unique_ptr<WallpaperTarget> CreateNativeWallpaperTarget()
+{
+    return std::make_unique<Win32WallpaperTarget>();
+}
+
+std::unique_ptr<MemoryMapper> CreateNativeMemoryMapper()
+{
+    return std::make_unique<Win32MemoryMapper>();
+}
+
+}
+
+#endif
\ No newline at end of file
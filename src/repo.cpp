@@ -1,71 +1,79 @@
 #include "repo.h"
 #include "config.h"
 #include "displays.h"
+#include "intern.h"
 #include "log.h"
+#include "metadata.h"
+#include "metrics.h"
 #include "paths.h"
-#include "util.h"
-
-#include <imageinfo.hpp>
+#include "trace.h"
+#include "walk.h"
+#include "watch.h"
 
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <format>
 #include <random>
+#include <unordered_set>
 
 namespace wallflow {
 
 std::map<std::string, int> repo_indexes;
-std::map<std::string, std::vector<std::string>> repo_files;
+std::map<std::string, std::vector<ImageId>> repo_files;
+std::atomic<uint64_t> repo_generation = 0;
+
+const std::vector<std::string> allowed_extensions = { "png", "jpg", "jpeg" };
 
-std::string GetRepoPath(std::string repo_key)
+std::string GetRepoPath(const std::string& root_path, const std::string& repo_key)
 {
-    WF_LOG(LogLevel::LINFO, std::format("retrieving wallpaper path for repo ({})", repo_key));
-    return std::format("{}\\{}", config->wallpaperDir, repo_key);
+    return (std::filesystem::path(root_path) / repo_key).string();
 }
 
-std::mutex populate_repo_mtx;
-
-bool IsSupportedFormat(IIFormat format)
+std::vector<std::string> GetRepoPaths(const std::string& repo_key)
 {
-    switch (format) {
-    case II_FORMAT_PNG:
-        return true;
-    default:
-        return false;
+    WF_LOG(LogLevel::LINFO, "retrieving wallpaper paths for repo ({})", repo_key);
+
+    // the main directory first, then any extra libraries, each holding the same per size folders
+    std::vector<std::string> repo_paths = { GetRepoPath(config->wallpaperDir, repo_key) };
+    for (const std::string& root_path : config->wallpaperDirs) {
+        repo_paths.push_back(GetRepoPath(root_path, repo_key));
     }
+    return repo_paths;
 }
 
-std::vector<std::string> GetVerifiedImages(std::vector<std::string> files, uint16_t width, uint16_t height)
-{
-    std::vector<std::string> result;
-    for (int i = 0; i < files.size(); i++) {
-        WF_LOG(LogLevel::LINFO, std::format("verifying image {}", files[i]));
-        ImageInfo info = getImageInfo<IIFilePathReader>(files[i]);
-        IIFormat format = info.getFormat();
+std::mutex populate_repo_mtx;
 
-        if (!IsSupportedFormat(format)) {
-            WF_LOG(LogLevel::LWARNING, "image (" + files[i] + ") unsupported format");
+std::vector<ImageId> GetVerifiedImages(const std::vector<std::string>& files)
+{
+    // only files that are new or changed since the last run are probed again
+    std::vector<std::optional<ImageMetadata>> metadata = GetImagesMetadata(files);
+
+    std::vector<ImageId> result;
+    result.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!metadata[i]) {
+            WF_LOG(LogLevel::LWARNING, "image ({}) could not be read", files[i]);
             continue;
         }
 
-        if (info.getWidth() != width || info.getHeight() != height) {
-            WF_LOG(LogLevel::LWARNING, "image (" + files[i] + ") invalid size");
+        if (!metadata[i]->verified) {
             continue;
         }
 
-        WF_LOG(LogLevel::LINFO, std::format("verified image {}", files[i]));
-
-        result.push_back(files[i]);
+        result.push_back(InternImagePath(files[i]));
     }
     return result;
 }
 
-std::vector<std::string> GetValidImageFiles(std::string repo_path, uint16_t width, uint16_t height)
+std::vector<ImageId> GetValidImageFiles(const std::vector<std::string>& repo_paths)
 {
-    WF_LOG(LogLevel::LINFO, std::format("retrieving valid image files in directory ()", repo_path));
-    std::vector<std::string> allowed_extensions = { "png" };
-    std::vector<std::string> unverified_image_files = GetFilesWithExtensions(repo_path, allowed_extensions);
-    return GetVerifiedImages(unverified_image_files, width, height);
+    WF_LOG(LogLevel::LINFO, "retrieving valid image files under {} directories", repo_paths.size());
+    std::vector<std::string> unverified_image_files = WalkFilesWithExtensions(repo_paths, allowed_extensions);
+    for (const std::string& repo_path : repo_paths) {
+        PruneImageMetadata(repo_path, unverified_image_files);
+    }
+    return GetVerifiedImages(unverified_image_files);
 }
 
 std::string GetRepoKey(uint16_t width, uint16_t height)
@@ -75,7 +83,7 @@ std::string GetRepoKey(uint16_t width, uint16_t height)
 
 void CreateRepoDirIfNotFound(std::string path)
 {
-    WF_LOG(LogLevel::LINFO, std::format("creating {} if not found", path));
+    WF_LOG(LogLevel::LINFO, "creating {} if not found", path);
     if (std::filesystem::exists(path)) {
         if (!std::filesystem::is_directory(path)) {
             throw std::runtime_error("expected wallpaper path (" + path + ") to be a directory, it is not.");
@@ -88,7 +96,7 @@ void CreateRepoDirIfNotFound(std::string path)
     }
 }
 
-void ShuffleImageFiles(std::vector<std::string>& image_files)
+void ShuffleImageFiles(std::vector<ImageId>& image_files)
 {
     WF_LOG(LogLevel::LINFO, "shuffling image files");
     std::random_device rd;
@@ -96,34 +104,56 @@ void ShuffleImageFiles(std::vector<std::string>& image_files)
     std::shuffle(image_files.begin(), image_files.end(), rng);
 }
 
-void PopulateRepo(uint16_t width, uint16_t height)
+// expects populate_repo_mtx to be held
+void PopulateRepoFiles(uint16_t width, uint16_t height)
 {
-    std::lock_guard<std::mutex> lock(populate_repo_mtx);
+    static Histogram& populate_duration = GetHistogram("wallflow_repo_populate_duration_microseconds", "Time to walk, verify and load a repo");
+
+    HistogramTimer populate_timer(populate_duration);
+    WF_TRACE_SCOPE("PopulateRepo");
 
     std::string key = GetRepoKey(width, height);
-    WF_LOG(LogLevel::LINFO, std::format("populating repo ()", key));
+    WF_LOG(LogLevel::LINFO, "populating repo ({})", key);
 
     repo_indexes[key] = -1;
 
-    std::string repo_path = GetRepoPath(key);
-    CreateRepoDirIfNotFound(repo_path);
+    std::vector<std::string> repo_paths = GetRepoPaths(key);
+    CreateRepoDirIfNotFound(repo_paths[0]);
 
-    std::vector<std::string> image_files = GetValidImageFiles(repo_path, width, height);
+    // anything that changes from here on is picked up by the next cycle
+    for (const std::string& repo_path : repo_paths) {
+        if (std::filesystem::is_directory(repo_path)) {
+            WatchDirectory(repo_path);
+            MarkDirectoryScanned(repo_path);
+        }
+    }
+
+    // the walk comes back sorted, which is the order added files are slotted into without shuffle
+    std::vector<ImageId> image_files = GetValidImageFiles(repo_paths);
 
     if (config->shuffle) {
         ShuffleImageFiles(image_files);
     }
 
-    for (int i = 0; i < image_files.size(); i++) {
-        WF_LOG(LogLevel::LINFO, "image loaded (" + image_files[i] + ")");
-    }
+    WF_LOG(LogLevel::LINFO, "{} images loaded for repo {}", image_files.size(), key);
+
+    repo_files[key] = std::move(image_files);
+    repo_generation++;
 
-    repo_files[key] = image_files;
+    WF_LOG_OBJ(GetPathArenaStats());
+
+    SaveMetadataIndex();
+}
+
+void PopulateRepo(uint16_t width, uint16_t height)
+{
+    std::lock_guard<std::mutex> lock(populate_repo_mtx);
+    PopulateRepoFiles(width, height);
 }
 
 void PopulateAllRepos()
 {
-    WF_START_TIMER("PopulateAllRepos()");
+    WF_TRACE_SCOPE("PopulateAllRepos");
     std::map<std::string, Display> unique_display_sizes;
 
     for (Display display : displays) {
@@ -133,39 +163,231 @@ void PopulateAllRepos()
     for (const auto& pair : unique_display_sizes) {
         PopulateRepo(pair.second.width, pair.second.height);
     }
-    WF_END_TIMER("PopulateAllRepos()");
 }
 
-bool FilesHaveChanged(uint16_t width, uint16_t height)
+bool IsImagePath(const std::string& path)
+{
+    return HasExtension(path, allowed_extensions);
+}
+
+std::mt19937& GetRepoRng()
+{
+    static std::mt19937 rng(std::random_device {}());
+    return rng;
+}
+
+// expects populate_repo_mtx to be held
+void InsertRepoFile(const std::string& key, ImageId id)
+{
+    std::vector<ImageId>& files = repo_files[key];
+    int& index = repo_indexes[key];
+    size_t position;
+
+    if (config->shuffle) {
+        // somewhere in the part of the rotation that has not been shown yet
+        std::uniform_int_distribution<size_t> distribution(index + 1, files.size());
+        position = distribution(GetRepoRng());
+    } else {
+        std::string path = GetImagePath(id);
+        position = std::lower_bound(files.begin(), files.end(), path, ImagePathLess) - files.begin();
+    }
+
+    WF_LOG(LogLevel::LINFO, "image added ({}) at {}", GetImagePath(id), position);
+    files.insert(files.begin() + position, id);
+    if (static_cast<int>(position) <= index) {
+        index++;
+    }
+}
+
+// expects populate_repo_mtx to be held
+void RemoveRepoFile(const std::string& key, std::vector<ImageId>::iterator it)
+{
+    std::vector<ImageId>& files = repo_files[key];
+    int& index = repo_indexes[key];
+    int position = static_cast<int>(it - files.begin());
+
+    WF_LOG(LogLevel::LINFO, "image removed ({}) at {}", GetImagePath(*it), position);
+    files.erase(it);
+    // whatever slid into the removed slot is next, the rotation does not skip it
+    if (position <= index) {
+        index--;
+    }
+}
+
+// expects populate_repo_mtx to be held
+bool ApplyRepoChanges(const std::string& key, const std::vector<std::string>& paths)
+{
+    std::vector<ImageId>& files = repo_files[key];
+    bool changed = false;
+
+    for (const std::string& path : paths) {
+        if (!IsImagePath(path)) {
+            continue;
+        }
+
+        // a file that is gone fails to stat and leaves like one that failed verification
+        ImageMetadata metadata;
+        bool exists = GetImageMetadata(path, metadata);
+        bool valid = exists && metadata.verified;
+        if (!exists) {
+            RemoveImageMetadata(path);
+        }
+
+        ImageId id;
+        auto it = FindImagePath(path, id) ? std::find(files.begin(), files.end(), id) : files.end();
+        if (valid && it == files.end()) {
+            InsertRepoFile(key, InternImagePath(path));
+            changed = true;
+        } else if (!valid && it != files.end()) {
+            RemoveRepoFile(key, it);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// expects populate_repo_mtx to be held
+bool ApplyRepoRescan(const std::string& key, const std::vector<std::string>& repo_paths)
+{
+    std::vector<ImageId> listed = GetValidImageFiles(repo_paths);
+    std::unordered_set<ImageId> listed_set(listed.begin(), listed.end());
+    std::vector<ImageId>& files = repo_files[key];
+    std::unordered_set<ImageId> current_set(files.begin(), files.end());
+    bool changed = false;
+
+    for (auto it = files.begin(); it != files.end();) {
+        if (listed_set.find(*it) == listed_set.end()) {
+            size_t position = it - files.begin();
+            RemoveRepoFile(key, it);
+            it = files.begin() + position;
+            changed = true;
+        } else {
+            it++;
+        }
+    }
+
+    for (ImageId id : listed) {
+        if (current_set.find(id) == current_set.end()) {
+            InsertRepoFile(key, id);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool IsDirectoryChange(const std::string& path)
+{
+    if (IsImagePath(path)) {
+        return false;
+    }
+    if (std::filesystem::is_directory(path)) {
+        return true;
+    }
+
+    // a folder that was removed or renamed away only shows up as its own name,
+    // one lookup in the known folders tells it from a temp file or a sidecar
+    return IsImageDirPrefix((std::filesystem::path(path) / "").string());
+}
+
+// expects populate_repo_mtx to be held
+void UpdateRepo(uint16_t width, uint16_t height)
 {
     std::string key = GetRepoKey(width, height);
-    std::string repo_path = GetRepoPath(key);
 
-    return !StringVectorsMatch(
-        repo_files[key],
-        GetValidImageFiles(repo_path, width, height));
+    if (repo_files.find(key) == repo_files.end()) {
+        PopulateRepoFiles(width, height);
+        return;
+    }
+
+    std::vector<std::string> repo_paths = GetRepoPaths(key);
+    DirectoryChanges changes = { false, {} };
+    bool has_changes = false;
+
+    for (const std::string& repo_path : repo_paths) {
+        // extra libraries without a folder for this size are found again by the next rescan
+        if (repo_path != repo_paths[0] && !std::filesystem::is_directory(repo_path)) {
+            continue;
+        }
+
+        DirectoryChanges dir_changes;
+        if (!TakeDirectoryChanges(repo_path, dir_changes)) {
+            continue;
+        }
+        WF_LOG_OBJ(dir_changes);
+
+        has_changes = true;
+        changes.rescan = changes.rescan || dir_changes.rescan;
+        changes.paths.insert(changes.paths.end(), dir_changes.paths.begin(), dir_changes.paths.end());
+    }
+
+    if (!has_changes) {
+        return;
+    }
+
+    // whole folders coming and going are walked again rather than tracked file by file
+    for (const std::string& path : changes.paths) {
+        if (!changes.rescan && IsDirectoryChange(path)) {
+            WF_LOG(LogLevel::LINFO, "folder {} changed, rescanning repo {}", path, key);
+            changes.rescan = true;
+        }
+    }
+
+    static Counter& repo_rescans = GetCounter("wallflow_repo_updates", "Repo updates after directory changes, by how they were applied", "kind=\"rescan\"");
+    static Counter& repo_incremental = GetCounter("wallflow_repo_updates", "Repo updates after directory changes, by how they were applied", "kind=\"incremental\"");
+    static Counter& changed_paths = GetCounter("wallflow_repo_changed_paths", "Paths reported changed by the directory watcher");
+    (changes.rescan ? repo_rescans : repo_incremental).Add();
+    changed_paths.Add(changes.paths.size());
+
+    // only what changed is verified, and the rotation carries on where it was
+    bool changed = changes.rescan
+        ? ApplyRepoRescan(key, repo_paths)
+        : ApplyRepoChanges(key, changes.paths);
+
+    if (changed) {
+        WF_LOG(LogLevel::LINFO, "repo {} now has {} images, position {}", key, repo_files[key].size(), repo_indexes[key]);
+        repo_generation++;
+    }
+
+    if (changes.rescan) {
+        for (const std::string& repo_path : repo_paths) {
+            if (std::filesystem::is_directory(repo_path)) {
+                WatchDirectory(repo_path);
+            }
+        }
+    }
+}
+
+uint64_t GetRepoGeneration()
+{
+    return repo_generation.load();
 }
 
 std::string GetNextImage(uint16_t width, uint16_t height)
 {
+    WF_TRACE_SCOPE("GetNextImage");
     std::string key = GetRepoKey(width, height);
-    WF_LOG(LogLevel::LINFO, std::format("retrieving next image for repo ()", key));
+    WF_LOG(LogLevel::LINFO, "retrieving next image for repo ({})", key);
 
-    if (FilesHaveChanged(width, height)) {
-        WF_LOG(LogLevel::LINFO, std::format("files for repo {} have changed, repopulating", key));
-        PopulateRepo(width, height);
+    std::string path;
+    {
+        // the repo may not change between the update and picking the image from it
+        std::lock_guard<std::mutex> lock(populate_repo_mtx);
+        UpdateRepo(width, height);
+
+        if (repo_files[key].size() > 0) {
+            repo_indexes[key] = (repo_indexes[key] + 1) % static_cast<int>(repo_files[key].size());
+            path = GetImagePath(repo_files[key][repo_indexes[key]]);
+        }
     }
+    SaveMetadataIndex();
 
-    if (repo_files[key].size() == 0) {
-        WF_LOG(LogLevel::LINFO, std::format("no images found for repo ()", key));
+    if (path.empty()) {
+        WF_LOG(LogLevel::LINFO, "no images found for repo ({})", key);
         return "";
     }
 
-    repo_indexes[key] = repo_indexes[key] + 1;
-    int index = repo_indexes[key] % repo_files[key].size();
-
-    WF_LOG(LogLevel::LINFO, std::format("found image ()", repo_files[key][index]));
-    return repo_files[key][index];
+    WF_LOG(LogLevel::LINFO, "found image ({})", path);
+    return path;
 }
 
 }
\ No newline at end of file
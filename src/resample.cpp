@@ -0,0 +1,336 @@
+#include "resample.h"
+#include "kernels.h"
+#include "log.h"
+#include "mem.h"
+#include "workers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+namespace wallflow {
+
+// rows handed to one worker per pass, small enough to balance across cores
+// and large enough that the per-task overhead disappears
+const size_t resample_band_rows = 32;
+
+const double pi = 3.14159265358979323846;
+
+const uint8_t background_pixel[3] = { 0x00, 0x00, 0x00 };
+
+std::string PlacementGeometry::ToString()
+{
+    return std::format(
+        "PlacementGeometry(srcX={},srcY={},srcWidth={},srcHeight={},dstX={},dstY={},dstWidth={},dstHeight={})",
+        srcX,
+        srcY,
+        srcWidth,
+        srcHeight,
+        dstX,
+        dstY,
+        dstWidth,
+        dstHeight);
+}
+
+ResampleFilter ParseResampleFilter(const std::string& name)
+{
+    if (name == "box") {
+        return ResampleFilter::Box;
+    }
+    if (name == "bilinear") {
+        return ResampleFilter::Bilinear;
+    }
+    if (name == "lanczos3") {
+        return ResampleFilter::Lanczos3;
+    }
+    throw std::runtime_error(std::format("unknown resample filter: {}", name));
+}
+
+Placement ParsePlacement(const std::string& name)
+{
+    if (name == "fit") {
+        return Placement::Fit;
+    }
+    if (name == "fill" || name == "crop") {
+        return Placement::Fill;
+    }
+    if (name == "center") {
+        return Placement::Center;
+    }
+    if (name == "stretch") {
+        return Placement::Stretch;
+    }
+    throw std::runtime_error(std::format("unknown placement: {}", name));
+}
+
+const char* GetPlacementName(Placement placement)
+{
+    switch (placement) {
+    case Placement::Fit:
+        return "fit";
+    case Placement::Fill:
+        return "fill";
+    case Placement::Center:
+        return "center";
+    case Placement::Stretch:
+        return "stretch";
+    }
+    return "unknown";
+}
+
+const char* GetResampleFilterName(ResampleFilter filter)
+{
+    switch (filter) {
+    case ResampleFilter::Box:
+        return "box";
+    case ResampleFilter::Bilinear:
+        return "bilinear";
+    case ResampleFilter::Lanczos3:
+        return "lanczos3";
+    }
+    return "unknown";
+}
+
+PlacementGeometry GetPlacementGeometry(uint32_t src_width, uint32_t src_height, uint16_t dst_width, uint16_t dst_height, Placement placement)
+{
+    PlacementGeometry geometry = { 0.0, 0.0, static_cast<double>(src_width), static_cast<double>(src_height), 0, 0, dst_width, dst_height };
+    double scale_x = static_cast<double>(dst_width) / src_width;
+    double scale_y = static_cast<double>(dst_height) / src_height;
+
+    switch (placement) {
+    case Placement::Fit: {
+        double scale = std::min(scale_x, scale_y);
+        geometry.dstWidth = static_cast<uint16_t>(std::clamp(std::lround(src_width * scale), 1L, static_cast<long>(dst_width)));
+        geometry.dstHeight = static_cast<uint16_t>(std::clamp(std::lround(src_height * scale), 1L, static_cast<long>(dst_height)));
+        geometry.dstX = (dst_width - geometry.dstWidth) / 2;
+        geometry.dstY = (dst_height - geometry.dstHeight) / 2;
+        break;
+    }
+    case Placement::Fill: {
+        double scale = std::max(scale_x, scale_y);
+        geometry.srcWidth = std::min(dst_width / scale, static_cast<double>(src_width));
+        geometry.srcHeight = std::min(dst_height / scale, static_cast<double>(src_height));
+        geometry.srcX = (src_width - geometry.srcWidth) / 2;
+        geometry.srcY = (src_height - geometry.srcHeight) / 2;
+        break;
+    }
+    case Placement::Center: {
+        // no scaling, whole pixels on both sides so it stays a straight copy
+        geometry.dstWidth = static_cast<uint16_t>(std::min<uint32_t>(src_width, dst_width));
+        geometry.dstHeight = static_cast<uint16_t>(std::min<uint32_t>(src_height, dst_height));
+        geometry.srcWidth = geometry.dstWidth;
+        geometry.srcHeight = geometry.dstHeight;
+        geometry.srcX = (src_width - geometry.dstWidth) / 2;
+        geometry.srcY = (src_height - geometry.dstHeight) / 2;
+        geometry.dstX = (dst_width - geometry.dstWidth) / 2;
+        geometry.dstY = (dst_height - geometry.dstHeight) / 2;
+        break;
+    }
+    case Placement::Stretch:
+        break;
+    }
+
+    return geometry;
+}
+
+double GetFilterSupport(ResampleFilter filter)
+{
+    switch (filter) {
+    case ResampleFilter::Box:
+        return 0.5;
+    case ResampleFilter::Bilinear:
+        return 1.0;
+    case ResampleFilter::Lanczos3:
+        return 3.0;
+    }
+    return 1.0;
+}
+
+double Sinc(double x)
+{
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= pi;
+    return std::sin(x) / x;
+}
+
+double GetFilterWeight(ResampleFilter filter, double x)
+{
+    switch (filter) {
+    case ResampleFilter::Box:
+        return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+    case ResampleFilter::Bilinear:
+        x = std::abs(x);
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case ResampleFilter::Lanczos3:
+        return x > -3.0 && x < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+    }
+    return 0.0;
+}
+
+// Fixed-point weights for one axis. Every output has the same number of taps
+// so the kernels never branch on it; windows near the edges are shifted
+// inwards and padded with zero weights instead of reading out of bounds.
+struct FilterContributions {
+    int taps;
+    std::vector<int32_t> starts;
+    std::vector<int16_t> weights;
+};
+
+FilterContributions ComputeContributions(uint32_t in_size, uint32_t out_size, double offset, double extent, ResampleFilter filter)
+{
+    double scale = extent / out_size;
+    // when shrinking the filter is stretched over the source so every input pixel contributes
+    double filter_scale = std::max(scale, 1.0);
+    double support = GetFilterSupport(filter) * filter_scale;
+
+    FilterContributions contributions;
+    contributions.taps = static_cast<int>(std::min<double>(std::ceil(support) * 2 + 1, in_size));
+    contributions.starts.resize(out_size);
+    contributions.weights.assign(static_cast<size_t>(out_size) * contributions.taps, 0);
+
+    int taps = contributions.taps;
+    int last = static_cast<int>(in_size);
+    std::vector<double> raw(taps);
+
+    for (uint32_t i = 0; i < out_size; i++) {
+        double center = offset + (i + 0.5) * scale;
+        int start = std::max(0, static_cast<int>(std::floor(center - support + 0.5)));
+        int end = std::min(last, static_cast<int>(std::floor(center + support + 0.5)));
+        start = std::min(start, last - 1);
+        end = std::clamp(end, start + 1, start + taps);
+
+        int base = std::min(start, last - taps);
+        double total = 0.0;
+        std::fill(raw.begin(), raw.end(), 0.0);
+        for (int j = start; j < end; j++) {
+            double weight = GetFilterWeight(filter, (j + 0.5 - center) / filter_scale);
+            raw[j - base] = weight;
+            total += weight;
+        }
+        if (total == 0.0) {
+            // the window fell between samples, take the nearest one
+            raw[start - base] = 1.0;
+            total = 1.0;
+        }
+
+        int16_t* weights = contributions.weights.data() + static_cast<size_t>(i) * taps;
+        int32_t sum = 0;
+        int largest = 0;
+        for (int k = 0; k < taps; k++) {
+            weights[k] = static_cast<int16_t>(std::lround(raw[k] / total * (1 << resample_precision)));
+            sum += weights[k];
+            if (weights[k] > weights[largest]) {
+                largest = k;
+            }
+        }
+        // rounding must not shift the overall brightness
+        weights[largest] = static_cast<int16_t>(weights[largest] + (1 << resample_precision) - sum);
+
+        contributions.starts[i] = base;
+    }
+
+    return contributions;
+}
+
+void CopyPixels(PixelView src, uint32_t src_x, uint32_t src_y, PixelView dst)
+{
+    for (uint16_t y = 0; y < dst.height; y++) {
+        memcpy(dst.data + y * dst.stride, src.data + (src_y + y) * src.stride + src_x * 3, static_cast<size_t>(dst.width) * 3);
+    }
+}
+
+void Resample(PixelView src, double src_x, double src_y, double src_width, double src_height, PixelView dst, ResampleFilter filter)
+{
+    if (src.width == 0 || src.height == 0 || dst.width == 0 || dst.height == 0) {
+        return;
+    }
+
+    if (src_width == dst.width && src_height == dst.height && src_x == std::floor(src_x) && src_y == std::floor(src_y)) {
+        CopyPixels(src, static_cast<uint32_t>(src_x), static_cast<uint32_t>(src_y), dst);
+        return;
+    }
+
+    const PixelKernels& kernels = GetPixelKernels();
+    FilterContributions horizontal = ComputeContributions(src.width, dst.width, src_x, src_width, filter);
+    FilterContributions vertical = ComputeContributions(src.height, dst.height, src_y, src_height, filter);
+
+    // only the source rows the vertical pass reads are filtered horizontally
+    size_t first_row = vertical.starts.front();
+    size_t row_count = vertical.starts.back() + vertical.taps - first_row;
+    size_t row_size = static_cast<size_t>(dst.width) * 3;
+    // pooled like the decode scratch, the next placement of a similar size reuses it
+    MemoryBufferHandle intermediate_handle = AcquireMemoryBuffer(row_count * row_size);
+    uint8_t* intermediate = GetMemoryBuffer(intermediate_handle).ptr;
+
+    try {
+        RunParallel((row_count + resample_band_rows - 1) / resample_band_rows, [&](size_t band) {
+            size_t end = std::min(row_count, (band + 1) * resample_band_rows);
+            for (size_t row = band * resample_band_rows; row < end; row++) {
+                kernels.resampleHorizontal(
+                    src.data + static_cast<ptrdiff_t>(first_row + row) * src.stride,
+                    src.width,
+                    intermediate + row * row_size,
+                    dst.width,
+                    horizontal.starts.data(),
+                    horizontal.weights.data(),
+                    horizontal.taps);
+            }
+        });
+
+        RunParallel((dst.height + resample_band_rows - 1) / resample_band_rows, [&](size_t band) {
+            std::vector<const uint8_t*> rows(vertical.taps);
+            size_t end = std::min<size_t>(dst.height, (band + 1) * resample_band_rows);
+            for (size_t y = band * resample_band_rows; y < end; y++) {
+                for (int k = 0; k < vertical.taps; k++) {
+                    rows[k] = intermediate + (vertical.starts[y] - first_row + k) * row_size;
+                }
+                kernels.resampleVertical(
+                    rows.data(),
+                    dst.data + static_cast<ptrdiff_t>(y) * dst.stride,
+                    row_size,
+                    vertical.weights.data() + y * vertical.taps,
+                    vertical.taps);
+            }
+        });
+    } catch (...) {
+        ReleaseMemoryBuffer(intermediate_handle);
+        throw;
+    }
+
+    ReleaseMemoryBuffer(intermediate_handle);
+}
+
+void PlaceImage(PixelView src, PixelView dst, Placement placement, ResampleFilter filter)
+{
+    PlacementGeometry geometry = GetPlacementGeometry(src.width, src.height, dst.width, dst.height, placement);
+    WF_LOG_OBJ(geometry);
+
+    const PixelKernels& kernels = GetPixelKernels();
+
+    // letterbox and pillarbox bars
+    for (uint16_t y = 0; y < dst.height; y++) {
+        uint8_t* row = dst.data + y * dst.stride;
+        if (y < geometry.dstY || y >= geometry.dstY + geometry.dstHeight) {
+            kernels.fill(row, dst.width, background_pixel);
+            continue;
+        }
+        kernels.fill(row, geometry.dstX, background_pixel);
+        uint16_t right = geometry.dstX + geometry.dstWidth;
+        kernels.fill(row + right * 3, dst.width - right, background_pixel);
+    }
+
+    PixelView target = {
+        dst.data + geometry.dstY * dst.stride + geometry.dstX * 3,
+        dst.stride,
+        geometry.dstWidth,
+        geometry.dstHeight
+    };
+    Resample(src, geometry.srcX, geometry.srcY, geometry.srcWidth, geometry.srcHeight, target, filter);
+}
+
+}
\ No newline at end of file
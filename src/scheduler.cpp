@@ -0,0 +1,169 @@
+#include "scheduler.h"
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace wallflow {
+
+struct ScheduledTimer {
+    SchedulerClock::time_point due;
+    uint64_t sequence;
+    std::string key;
+};
+
+struct LaterTimer {
+    bool operator()(const ScheduledTimer& a, const ScheduledTimer& b) const
+    {
+        return a.due != b.due ? a.due > b.due : a.sequence > b.sequence;
+    }
+};
+
+struct PendingJob {
+    uint64_t sequence;
+    std::function<void()> job;
+};
+
+// Replacing or cancelling a timer leaves its heap entry behind, an entry only
+// counts while its sequence is still the one of the pending job for its key.
+std::priority_queue<ScheduledTimer, std::vector<ScheduledTimer>, LaterTimer> scheduler_timers;
+std::map<std::string, PendingJob> scheduler_jobs;
+std::deque<std::function<void()>> scheduler_tasks;
+uint64_t next_timer_sequence = 1;
+bool scheduler_stopping = false;
+std::thread scheduler_thread;
+std::condition_variable scheduler_cv;
+
+std::mutex scheduler_mtx;
+
+// expects scheduler_mtx to be held
+void DropCancelledTimers()
+{
+    while (!scheduler_timers.empty()) {
+        const ScheduledTimer& timer = scheduler_timers.top();
+        auto it = scheduler_jobs.find(timer.key);
+        if (it != scheduler_jobs.end() && it->second.sequence == timer.sequence) {
+            return;
+        }
+        scheduler_timers.pop();
+    }
+}
+
+void RunSchedulerJob(const std::function<void()>& job)
+{
+    try {
+        job();
+    } catch (const std::exception& ex) {
+        WF_LOG(LogLevel::LERROR, ex.what());
+    }
+}
+
+void RunScheduler()
+{
+    static Counter& wakeups = GetCounter("wallflow_scheduler_wakeups", "Times the scheduler thread woke up");
+    static Counter& jobs_run = GetCounter("wallflow_scheduler_jobs", "Timers and tasks the scheduler ran");
+
+    SetTraceThreadName("scheduler");
+    std::unique_lock<std::mutex> lock(scheduler_mtx);
+
+    while (!scheduler_stopping) {
+        DropCancelledTimers();
+
+        std::function<void()> job;
+        if (!scheduler_tasks.empty()) {
+            job = std::move(scheduler_tasks.front());
+            scheduler_tasks.pop_front();
+        } else if (scheduler_timers.empty()) {
+            scheduler_cv.wait(lock);
+            wakeups.Add();
+            continue;
+        } else if (SchedulerClock::time_point due = scheduler_timers.top().due; due > SchedulerClock::now()) {
+            scheduler_cv.wait_until(lock, due);
+            wakeups.Add();
+            continue;
+        } else {
+            auto it = scheduler_jobs.find(scheduler_timers.top().key);
+            job = std::move(it->second.job);
+            scheduler_jobs.erase(it);
+            scheduler_timers.pop();
+        }
+
+        // jobs may schedule more timers
+        lock.unlock();
+        RunSchedulerJob(job);
+        jobs_run.Add();
+        lock.lock();
+    }
+}
+
+void StartScheduler()
+{
+    std::lock_guard<std::mutex> lock(scheduler_mtx);
+    if (scheduler_thread.joinable()) {
+        return;
+    }
+
+    scheduler_stopping = false;
+    scheduler_thread = std::thread(RunScheduler);
+}
+
+void StopScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mtx);
+        scheduler_stopping = true;
+    }
+    scheduler_cv.notify_all();
+
+    if (scheduler_thread.joinable()) {
+        scheduler_thread.join();
+    }
+
+    // whatever the jobs captured goes with them
+    std::lock_guard<std::mutex> lock(scheduler_mtx);
+    scheduler_timers = {};
+    scheduler_jobs.clear();
+    scheduler_tasks.clear();
+}
+
+void ScheduleTimer(const std::string& key, SchedulerClock::time_point due, std::function<void()> job)
+{
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mtx);
+        uint64_t sequence = next_timer_sequence++;
+        scheduler_jobs[key] = { sequence, std::move(job) };
+        // only a new earliest deadline shortens the sleep
+        wake = scheduler_timers.empty() || due < scheduler_timers.top().due;
+        scheduler_timers.push({ due, sequence, key });
+    }
+
+    if (wake) {
+        scheduler_cv.notify_all();
+    }
+}
+
+void CancelTimer(const std::string& key)
+{
+    // the heap entry is dropped when it surfaces, at worst the thread wakes once for nothing
+    std::lock_guard<std::mutex> lock(scheduler_mtx);
+    scheduler_jobs.erase(key);
+}
+
+void PostSchedulerTask(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mtx);
+        scheduler_tasks.push_back(std::move(task));
+    }
+    scheduler_cv.notify_all();
+}
+
+}
\ No newline at end of file
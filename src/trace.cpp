@@ -0,0 +1,200 @@
+#include "trace.h"
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace wallflow {
+
+struct TraceEvent {
+    std::atomic<const char*> name;
+    std::atomic<int64_t> start;
+    std::atomic<int64_t> end;
+    std::atomic<uint32_t> thread;
+};
+
+// per thread, a power of two so the slot is a mask of the running count
+const size_t trace_ring_capacity = 8192;
+
+// Written only by the thread that owns it, read by the exporter at any time.
+// head counts every span ever written, the slot of span n is n % capacity.
+struct TraceRing {
+    std::array<TraceEvent, trace_ring_capacity> events;
+    std::atomic<uint64_t> head = 0;
+};
+
+std::vector<std::unique_ptr<TraceRing>> trace_rings;
+// rings of threads that exited, handed to the next new thread with their spans intact
+std::vector<TraceRing*> free_trace_rings;
+std::map<uint32_t, std::string> trace_thread_names;
+std::atomic<uint32_t> next_trace_thread = 1;
+
+std::mutex trace_mtx;
+
+std::string TraceStats::ToString()
+{
+    return std::format(
+        "TraceStats(spans={},dropped={},threads={})",
+        spans,
+        dropped,
+        threads);
+}
+
+struct TraceThread {
+    TraceRing* ring = nullptr;
+    uint32_t id = 0;
+
+    TraceRing* Attach()
+    {
+        std::lock_guard<std::mutex> lock(trace_mtx);
+        id = next_trace_thread++;
+        if (!free_trace_rings.empty()) {
+            ring = free_trace_rings.back();
+            free_trace_rings.pop_back();
+        } else {
+            trace_rings.push_back(std::make_unique<TraceRing>());
+            ring = trace_rings.back().get();
+        }
+        return ring;
+    }
+
+    ~TraceThread()
+    {
+        if (ring != nullptr) {
+            std::lock_guard<std::mutex> lock(trace_mtx);
+            free_trace_rings.push_back(ring);
+            ring = nullptr;
+        }
+    }
+};
+
+thread_local TraceThread trace_thread;
+
+void RecordTraceSpan(const char* name, int64_t start, int64_t end)
+{
+    TraceRing* ring = trace_thread.ring;
+    if (ring == nullptr) {
+        ring = trace_thread.Attach();
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring->events[head & (trace_ring_capacity - 1)];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    event.thread.store(trace_thread.id, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+
+    WF_LOG(LogLevel::LDEBUG, "[TIMER:{}] ENDED({:.3f}ms)", name, (end - start) / 1e6);
+}
+
+void SetTraceThreadName(const char* name)
+{
+    if (trace_thread.ring == nullptr) {
+        trace_thread.Attach();
+    }
+
+    std::lock_guard<std::mutex> lock(trace_mtx);
+    trace_thread_names[trace_thread.id] = name;
+}
+
+TraceStats GetTraceStats()
+{
+    std::lock_guard<std::mutex> lock(trace_mtx);
+    TraceStats stats = {};
+
+    for (const std::unique_ptr<TraceRing>& ring : trace_rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        stats.spans += head;
+        stats.dropped += head > trace_ring_capacity ? head - trace_ring_capacity : 0;
+    }
+    stats.threads = trace_rings.size() - free_trace_rings.size();
+    return stats;
+}
+
+struct ExportedTraceEvent {
+    const char* name;
+    int64_t start;
+    int64_t end;
+    uint32_t thread;
+};
+
+// expects trace_mtx to be held
+void CollectTraceEvents(const TraceRing& ring, std::vector<ExportedTraceEvent>& events)
+{
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t first = head > trace_ring_capacity ? head - trace_ring_capacity : 0;
+    size_t collected = events.size();
+
+    for (uint64_t i = first; i < head; i++) {
+        const TraceEvent& event = ring.events[i & (trace_ring_capacity - 1)];
+        events.push_back({
+            event.name.load(std::memory_order_relaxed),
+            event.start.load(std::memory_order_relaxed),
+            event.end.load(std::memory_order_relaxed),
+            event.thread.load(std::memory_order_relaxed),
+        });
+    }
+
+    // the owner kept writing while the slots were copied, whatever it may have
+    // overwritten (plus the slot of the span in flight) is dropped
+    uint64_t after = ring.head.load(std::memory_order_acquire);
+    uint64_t valid = after + 1 > trace_ring_capacity ? after + 1 - trace_ring_capacity : 0;
+    if (valid > first) {
+        size_t overwritten = static_cast<size_t>(std::min(valid, head) - first);
+        events.erase(events.begin() + collected, events.begin() + collected + overwritten);
+    }
+}
+
+void ExportTrace(const std::string& path)
+{
+    WF_LOG(LogLevel::LINFO, "exporting trace to {}", path);
+
+    std::vector<ExportedTraceEvent> events;
+    std::map<uint32_t, std::string> thread_names;
+    {
+        std::lock_guard<std::mutex> lock(trace_mtx);
+        for (const std::unique_ptr<TraceRing>& ring : trace_rings) {
+            CollectTraceEvents(*ring, events);
+        }
+        thread_names = trace_thread_names;
+    }
+
+    std::ofstream out_file(path, std::ios::binary | std::ios::trunc);
+    if (!out_file.is_open()) {
+        throw std::runtime_error(std::format("could not open trace file ({})", path));
+    }
+
+    // the Chrome trace event format, which Perfetto and chrome://tracing both load
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"wallflow\"}}";
+    for (const auto& [thread, name] : thread_names) {
+        out += std::format(",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", thread, name);
+    }
+    for (const ExportedTraceEvent& event : events) {
+        out += std::format(
+            ",\n{{\"name\":\"{}\",\"cat\":\"wallflow\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+            event.name,
+            event.thread,
+            event.start / 1e3,
+            (event.end - event.start) / 1e3);
+    }
+    out += "\n]}\n";
+
+    out_file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (!out_file) {
+        throw std::runtime_error(std::format("could not write trace file ({})", path));
+    }
+
+    WF_LOG(LogLevel::LINFO, "exported {} spans", events.size());
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "walk.h"
+#include "log.h"
+#include "paths.h"
+#include "trace.h"
+#include "workers.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <system_error>
+#include <unordered_set>
+
+namespace wallflow {
+
+struct WalkEntry {
+    std::string path;
+    // the same directory with every link resolved, known without asking the file system again
+    std::filesystem::path canonical;
+};
+
+struct WalkState {
+    const std::vector<std::string>* extensions;
+    // roots of every tree walked so far, a directory found here is never entered twice
+    std::unordered_set<std::string> trees;
+    std::deque<WalkEntry> queue;
+    size_t busy;
+    std::vector<std::string> files;
+    std::vector<std::string> links;
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+void WalkDirectory(WalkState& state, const WalkEntry& dir, std::vector<WalkEntry>& subdirs, std::vector<std::string>& files, std::vector<std::string>& links)
+{
+    std::error_code ec;
+    std::filesystem::directory_iterator it(dir.path, std::filesystem::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        WF_LOG(LogLevel::LWARNING, "could not list {}: {}", dir.path, ec.message());
+        return;
+    }
+
+    for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            WF_LOG(LogLevel::LWARNING, "listing {} stopped early: {}", dir.path, ec.message());
+            break;
+        }
+
+        // the entry type comes from the listing itself, only links need another look
+        const std::filesystem::directory_entry& entry = *it;
+        std::filesystem::file_type type = entry.symlink_status(ec).type();
+
+        if (type == std::filesystem::file_type::directory) {
+            std::filesystem::path canonical = dir.canonical / entry.path().filename();
+            subdirs.push_back({ entry.path().string(), canonical });
+        } else if (type == std::filesystem::file_type::regular) {
+            std::string path = entry.path().string();
+            if (HasExtension(path, *state.extensions)) {
+                files.push_back(path);
+            }
+        } else if (entry.is_directory(ec)) {
+            // symlinks and junctions are followed once every real directory is known
+            links.push_back(entry.path().string());
+        } else if (entry.is_regular_file(ec)) {
+            std::string path = entry.path().string();
+            if (HasExtension(path, *state.extensions)) {
+                files.push_back(path);
+            }
+        }
+    }
+}
+
+void RunWalkWorker(WalkState& state)
+{
+    std::vector<WalkEntry> subdirs;
+    std::vector<std::string> files;
+    std::vector<std::string> links;
+
+    std::unique_lock<std::mutex> lock(state.mtx);
+    while (true) {
+        state.cv.wait(lock, [&]() { return !state.queue.empty() || state.busy == 0; });
+        if (state.queue.empty()) {
+            return;
+        }
+
+        WalkEntry dir = std::move(state.queue.front());
+        state.queue.pop_front();
+        state.busy++;
+        lock.unlock();
+
+        subdirs.clear();
+        WalkDirectory(state, dir, subdirs, files, links);
+
+        lock.lock();
+        state.busy--;
+        for (WalkEntry& subdir : subdirs) {
+            // another tree of this walk starts here and covers it
+            if (state.trees.find(subdir.canonical.string()) == state.trees.end()) {
+                state.queue.push_back(std::move(subdir));
+            }
+        }
+        state.files.insert(state.files.end(), files.begin(), files.end());
+        state.links.insert(state.links.end(), links.begin(), links.end());
+        files.clear();
+        links.clear();
+
+        // either there is more to take or the last directory is done and everyone can leave
+        state.cv.notify_all();
+    }
+}
+
+bool IsInsideTree(const WalkState& state, const std::filesystem::path& canonical)
+{
+    for (std::filesystem::path path = canonical; !path.empty(); path = path.parent_path()) {
+        if (state.trees.find(path.string()) != state.trees.end()) {
+            return true;
+        }
+        if (path == path.root_path()) {
+            break;
+        }
+    }
+    return false;
+}
+
+// queues every candidate that is not already covered, in sorted order so the same paths win every run
+void PlanWalk(WalkState& state, std::vector<std::string> candidates)
+{
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const std::string& path : candidates) {
+        std::error_code ec;
+        std::filesystem::path canonical = std::filesystem::canonical(path, ec);
+        if (ec) {
+            WF_LOG(LogLevel::LWARNING, "could not resolve {}: {}", path, ec.message());
+            continue;
+        }
+        if (IsInsideTree(state, canonical)) {
+            WF_LOG(LogLevel::LINFO, "{} is already walked, skipping it", path);
+            continue;
+        }
+        state.trees.insert(canonical.string());
+        state.queue.push_back({ path, canonical });
+    }
+}
+
+std::vector<std::string> WalkFilesWithExtensions(const std::vector<std::string>& root_paths, const std::vector<std::string>& extensions)
+{
+    WF_TRACE_SCOPE("WalkFilesWithExtensions");
+
+    WalkState state;
+    state.extensions = &extensions;
+    state.busy = 0;
+
+    // roots first, then each round of links found by the one before, until no new tree turns up
+    std::vector<std::string> candidates = root_paths;
+    size_t round = 0;
+    while (!candidates.empty()) {
+        PlanWalk(state, std::move(candidates));
+        state.links.clear();
+
+        // every worker takes directories off the shared queue until the round runs dry
+        RunParallel(GetWorkerCount(SIZE_MAX), [&state](size_t) { RunWalkWorker(state); });
+
+        candidates = std::move(state.links);
+        state.links = {};
+        round++;
+    }
+
+    std::sort(state.files.begin(), state.files.end());
+
+    WF_LOG(LogLevel::LINFO, "walked {} trees in {} rounds, found {} files", state.trees.size(), round, state.files.size());
+    return std::move(state.files);
+}
+
+}
\ No newline at end of file
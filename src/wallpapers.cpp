@@ -1,304 +1,694 @@
 #include "wallpapers.h"
-#include "convert.h"
+#include "cache.h"
+#include "canvas.h"
+#include "config.h"
+#include "derivatives.h"
 #include "displays.h"
+#include "encoders.h"
+#include "kernels.h"
 #include "log.h"
 #include "mem.h"
+#include "metadata.h"
+#include "metrics.h"
 #include "paths.h"
+#include "platform.h"
 #include "repo.h"
+#include "resample.h"
+#include "trace.h"
+#include "workers.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include <csetjmp>
+#include <cstdio>
 
 #include <imageinfo.hpp>
+#include <jpeglib.h>
 #include <png.h>
-#include <stb_image_write.h>
-
-#include <windows.h>
 
 namespace wallflow {
 
 std::map<std::string, std::string> current_wallpapers;
 
-struct Dimensions {
-    uint16_t width;
-    uint16_t height;
+struct DecodeArena {
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+    std::vector<size_t> blockSizes;
+    size_t block;
+    size_t offset;
+    std::vector<png_bytep> rows;
 };
 
-Dimensions GetCanvasSize()
+std::vector<std::unique_ptr<DecodeArena>> decode_arenas;
+std::mutex decode_arenas_mtx;
+
+DecodeArena* AcquireDecodeArena()
 {
-    uint16_t width = 0;
-    uint16_t height = 0;
+    std::lock_guard<std::mutex> lock(decode_arenas_mtx);
+
+    DecodeArena* arena;
+    if (decode_arenas.empty()) {
+        arena = new DecodeArena();
+    } else {
+        arena = decode_arenas.back().release();
+        decode_arenas.pop_back();
+    }
 
-    for (Display display : displays) {
-        WF_LOG_OBJ(display);
-        uint16_t x = display.x + display.width;
-        uint16_t y = display.y + display.height;
+    arena->block = 0;
+    arena->offset = 0;
+    return arena;
+}
 
-        if (x > width) {
-            width = x;
-        }
-        if (y > height) {
-            height = y;
+void ReleaseDecodeArena(DecodeArena* arena)
+{
+    std::lock_guard<std::mutex> lock(decode_arenas_mtx);
+    decode_arenas.emplace_back(arena);
+}
+
+// libpng and zlib allocate the same handful of buffers for every decode, so
+// they are served from a reusable arena and released in one go afterwards
+png_voidp PNGArenaMalloc(png_structp png, png_alloc_size_t size)
+{
+    DecodeArena* arena = static_cast<DecodeArena*>(png_get_mem_ptr(png));
+    size = (size + 15) & ~static_cast<png_alloc_size_t>(15);
+
+    while (arena->block < arena->blocks.size()) {
+        if (arena->offset + size <= arena->blockSizes[arena->block]) {
+            uint8_t* ptr = arena->blocks[arena->block].get() + arena->offset;
+            arena->offset += size;
+            return ptr;
         }
+        arena->block++;
+        arena->offset = 0;
     }
-    WF_LOG(LogLevel::LINFO, std::format("GetCanvasSize(width={},height={})", width, height));
 
-    return { width, height };
+    try {
+        size_t block_size = std::max<size_t>(size, 256 * 1024);
+        arena->blocks.emplace_back(new uint8_t[block_size]);
+        arena->blockSizes.push_back(block_size);
+    } catch (const std::bad_alloc& ex) {
+        return NULL;
+    }
+
+    arena->block = arena->blocks.size() - 1;
+    arena->offset = size;
+    return arena->blocks.back().get();
+}
+
+// arena blocks are reused for the next decode rather than freed one by one
+void PNGArenaFree(png_structp, png_voidp)
+{
 }
 
-void ApplyPNGToWallpaperBuffer(uint8_t* buffer, std::string image_path, Display display, Dimensions canvas_size)
+void ApplyPNGToWallpaperBuffer(PixelView view, std::string image_path)
 {
     FILE* file = fopen(image_path.c_str(), "rb");
     if (!file) {
         throw std::runtime_error(std::format("could not open file ({})", image_path));
     }
 
-    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    DecodeArena* arena = AcquireDecodeArena();
+
+    png_structp png = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, arena, PNGArenaMalloc, PNGArenaFree);
     if (!png) {
-        throw std::runtime_error("error creating PNG read structure");
+        ReleaseDecodeArena(arena);
         fclose(file);
-        return;
+        throw std::runtime_error("error creating PNG read structure");
     }
 
     png_infop info = png_create_info_struct(png);
     if (!info) {
-        throw std::runtime_error("error creating PNG info structure");
         png_destroy_read_struct(&png, NULL, NULL);
+        ReleaseDecodeArena(arena);
         fclose(file);
-        return;
+        throw std::runtime_error("error creating PNG info structure");
     }
 
     if (setjmp(png_jmpbuf(png))) {
-        throw std::runtime_error("error during PNG read");
         png_destroy_read_struct(&png, &info, NULL);
+        ReleaseDecodeArena(arena);
         fclose(file);
-        return;
+        throw std::runtime_error(std::format("error during PNG read ({})", image_path));
     }
 
     png_init_io(png, file);
     png_read_info(png, info);
-    uint32_t width, height;
+    png_uint_32 width, height;
     int bit_depth, color_type;
-    int channels = png_get_channels(png, info);
     png_get_IHDR(png, info, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
-    if (bit_depth < 8) {
-        png_set_packing(png);
+
+    if (width > view.width || height > view.height) {
+        png_error(png, "image is larger than its display");
+    }
+
+    // let libpng expand everything to 8-bit BGR so rows can land in the canvas as is
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(png);
+    }
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+        png_set_expand_gray_1_2_4_to_8(png);
+    }
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        png_set_gray_to_rgb(png);
+    }
+    // expanding a palette turns its tRNS chunk into an alpha channel as well
+    if ((color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(png, info, PNG_INFO_tRNS)) {
+        png_set_strip_alpha(png);
     }
     if (bit_depth == 16) {
         png_set_strip_16(png);
     }
-    int passes = png_set_interlace_handling(png);
+    png_set_bgr(png);
+    png_set_interlace_handling(png);
     png_read_update_info(png, info);
 
-    for (int pass = 0; pass < passes; pass++) {
-        for (int y = 0; y < height; y++) {
-            int canvas_y = display.y + y;
-            int canvas_offset = (canvas_size.width * canvas_y + display.x) * 3;
-            size_t row_size = channels * width;
-
-            uint8_t* row = new uint8_t[row_size];
-
-            for (int i = 0; i < row_size; i += channels) {
-                size_t pixel_offset = canvas_offset + ((i / channels) * 3);
-                row[i + 0] = buffer[pixel_offset + 0];
-                row[i + 1] = buffer[pixel_offset + 1];
-                row[i + 2] = buffer[pixel_offset + 2];
-                if (channels == 4) {
-                    row[i + 3] = 0xFF;
-                }
-            }
+    if (png_get_rowbytes(png, info) != width * 3) {
+        png_error(png, "unexpected row size after transforms");
+    }
 
-            png_read_row(png, row, NULL);
+    if (arena->rows.size() < height) {
+        arena->rows.resize(height);
+    }
+    for (png_uint_32 y = 0; y < height; y++) {
+        arena->rows[y] = view.data + y * view.stride;
+    }
 
-            for (int i = 0; i < row_size; i += channels) {
-                uint8_t r = row[i + 0];
-                uint8_t g = row[i + 1];
-                uint8_t b = row[i + 2];
+    png_read_image(png, arena->rows.data());
 
-                size_t pixel_offset = canvas_offset + ((i / channels) * 3);
-                buffer[pixel_offset + 0] = r;
-                buffer[pixel_offset + 1] = g;
-                buffer[pixel_offset + 2] = b;
-            }
+    png_destroy_read_struct(&png, &info, NULL);
+    ReleaseDecodeArena(arena);
+    fclose(file);
+}
 
-            delete[] row;
+unsigned int GetJPEGScaleDenominator(uint32_t width, uint32_t height, uint16_t target_width, uint16_t target_height)
+{
+    // largest scaled IDCT reduction (1/8, 1/4, 1/2) that still covers the target
+    for (unsigned int denom = 8; denom > 1; denom /= 2) {
+        uint32_t scaled_width = (width + denom - 1) / denom;
+        uint32_t scaled_height = (height + denom - 1) / denom;
+        if (scaled_width >= target_width && scaled_height >= target_height) {
+            return denom;
         }
     }
+    return 1;
+}
 
-    png_destroy_info_struct(png, &info);
-    fclose(file);
+struct JPEGErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void JPEGErrorExit(j_common_ptr cinfo)
+{
+    JPEGErrorManager* err = reinterpret_cast<JPEGErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    longjmp(err->jump, 1);
 }
 
-void WritePNGFile(std::string path, uint8_t* data, int width, int height)
+void ApplyJPEGToWallpaperBuffer(PixelView view, std::string image_path, unsigned int scale_denom)
 {
-    FILE* fp = fopen(path.c_str(), "wb");
-    if (!fp) {
-        throw std::runtime_error("error opening PNG file for writing");
+    FILE* file = fopen(image_path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error(std::format("could not open file ({})", image_path));
     }
 
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png) {
-        fclose(fp);
-        throw std::runtime_error("error initializing libpng for writing");
+    jpeg_decompress_struct cinfo;
+    JPEGErrorManager jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = JPEGErrorExit;
+    jerr.message[0] = '\0';
+
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        throw std::runtime_error(std::format("error during JPEG read ({}): {}", image_path, jerr.message));
     }
 
-    png_infop info = png_create_info_struct(png);
-    if (!info) {
-        fclose(fp);
-        png_destroy_write_struct(&png, NULL);
-        throw std::runtime_error("error creating PNG info struct");
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, file);
+    jpeg_read_header(&cinfo, TRUE);
+
+    // libjpeg-turbo writes BGR straight into the canvas layout, and oversized
+    // sources are reduced inside the IDCT so they are never fully decoded
+    cinfo.out_color_space = JCS_EXT_BGR;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
+
+    jpeg_start_decompress(&cinfo);
+
+    if (cinfo.output_width != view.width || cinfo.output_height != view.height) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        throw std::runtime_error(std::format("scaled image ({}) does not match its buffer", image_path));
     }
 
-    if (setjmp(png_jmpbuf(png))) {
-        fclose(fp);
-        png_destroy_write_struct(&png, &info);
-        throw std::runtime_error("error during PNG file write");
+    JSAMPROW rows[4];
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JDIMENSION count = std::min<JDIMENSION>(cinfo.rec_outbuf_height, 4);
+        count = std::min(count, cinfo.output_height - cinfo.output_scanline);
+        for (JDIMENSION i = 0; i < count; i++) {
+            rows[i] = view.data + static_cast<ptrdiff_t>(cinfo.output_scanline + i) * view.stride;
+        }
+        jpeg_read_scanlines(&cinfo, rows, count);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(file);
+}
+
+void ApplyPlaceholderToWallpaperBuffer(PixelView view)
+{
+    const uint8_t pixel[3] = { 0x65, 0x2e, 0x46 };
+    const PixelKernels& kernels = GetPixelKernels();
+
+    for (int y = 0; y < view.height; y++) {
+        kernels.fill(view.data + y * view.stride, view.width, pixel);
     }
+}
 
-    png_init_io(png, fp);
+void BlitImageToWallpaperBuffer(PixelView view, const DecodedImage& image)
+{
+    size_t row_size = image.width * 3;
 
-    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    png_write_info(png, info);
+    for (int y = 0; y < image.height; y++) {
+        memcpy(view.data + y * view.stride, image.pixels.data() + y * row_size, row_size);
+    }
+}
 
-    for (int y = 0; y < height; y++) {
-        png_write_row(png, &data[y * width * 3]);
+Placement GetDisplayPlacement(const Display& display)
+{
+    auto it = config->displayPlacement.find(display.alias);
+    if (it == config->displayPlacement.end()) {
+        it = config->displayPlacement.find(display.id);
     }
+    std::string name = it != config->displayPlacement.end() ? it->second : config->placement;
 
-    png_write_end(png, info);
-    png_destroy_write_struct(&png, &info);
-    fclose(fp);
+    try {
+        return ParsePlacement(name);
+    } catch (const std::runtime_error& ex) {
+        WF_LOG(LogLevel::LWARNING, "{}, falling back to fill", ex.what());
+        return Placement::Fill;
+    }
 }
 
-void ApplyJPEGToWallpaperBuffer(uint8_t* buffer, std::string image_path, Display display, Dimensions canvas_size)
+ResampleFilter GetConfiguredResampleFilter()
 {
+    try {
+        return ParseResampleFilter(config->resampleFilter);
+    } catch (const std::runtime_error& ex) {
+        WF_LOG(LogLevel::LWARNING, "{}, falling back to lanczos3", ex.what());
+        return ResampleFilter::Lanczos3;
+    }
 }
 
-void ApplyPlaceholderToWallpaperBuffer(uint8_t* buffer, Display display, Dimensions canvas_size)
+std::string GetPlacementVariant(Placement placement, ResampleFilter filter)
 {
-    uint8_t r = 0x46;
-    uint8_t g = 0x2e;
-    uint8_t b = 0x65;
-
-    for (int y = 0; y < display.height; y++) {
-        for (int x = 0; x < display.width; x++) {
-            int row_offset = (display.y + y) * canvas_size.width * 3;
-            int col_offset = (display.x + x) * 3;
-            int canvas_offset = row_offset + col_offset;
-
-            buffer[canvas_offset + 0] = r;
-            buffer[canvas_offset + 1] = g;
-            buffer[canvas_offset + 2] = b;
-        }
+    return std::format("{}/{}", GetPlacementName(placement), GetResampleFilterName(filter));
+}
+
+void DecodeImageInto(PixelView view, const std::string& image_path, const ImageMetadata& metadata, unsigned int scale_denom)
+{
+    static Histogram& png_decode_duration = GetHistogram("wallflow_decode_duration_microseconds", "Time spent decoding an image, placement excluded", "format=\"png\"");
+    static Histogram& jpeg_decode_duration = GetHistogram("wallflow_decode_duration_microseconds", "Time spent decoding an image, placement excluded", "format=\"jpeg\"");
+
+    if (metadata.format == II_FORMAT_PNG) {
+        HistogramTimer timer(png_decode_duration);
+        ApplyPNGToWallpaperBuffer(view, image_path);
+    } else {
+        HistogramTimer timer(jpeg_decode_duration);
+        ApplyJPEGToWallpaperBuffer(view, image_path, scale_denom);
     }
 }
 
-void SetWallpaperStyleToSpan()
+void DecodeImageToWallpaperBuffer(PixelView view, std::string image_path, const ImageMetadata& metadata, Display display, Placement placement, ResampleFilter filter)
 {
-    HKEY hKey;
-    if (RegOpenKeyExW(HKEY_CURRENT_USER, L"Control Panel\\Desktop", 0, KEY_WRITE, &hKey) != ERROR_SUCCESS) {
-        throw std::exception("Could not change wallpaper fit to span");
+    WF_TRACE_SCOPE("DecodeImageToWallpaperBuffer");
+    uint32_t width = metadata.width;
+    uint32_t height = metadata.height;
+    unsigned int scale_denom = 1;
+
+    if (metadata.format == II_FORMAT_JPEG) {
+        // decode at the smallest IDCT scale that still covers the area the
+        // placement samples, the resampler takes it the rest of the way
+        PlacementGeometry geometry = GetPlacementGeometry(width, height, display.width, display.height, placement);
+        double needed_width = std::ceil(width * geometry.dstWidth / geometry.srcWidth);
+        double needed_height = std::ceil(height * geometry.dstHeight / geometry.srcHeight);
+        scale_denom = GetJPEGScaleDenominator(
+            width,
+            height,
+            static_cast<uint16_t>(std::min(needed_width, 65535.0)),
+            static_cast<uint16_t>(std::min(needed_height, 65535.0)));
+        width = (width + scale_denom - 1) / scale_denom;
+        height = (height + scale_denom - 1) / scale_denom;
     }
 
-    const wchar_t* wallpaperStyleValue = L"22";
-    RegSetValueExW(hKey, L"WallpaperStyle", 0, REG_SZ, (const BYTE*)wallpaperStyleValue, sizeof(wchar_t) * (wcslen(wallpaperStyleValue) + 1));
-    RegCloseKey(hKey);
+    if (width > UINT16_MAX || height > UINT16_MAX) {
+        throw std::runtime_error(std::format("image ({}) is too large", image_path));
+    }
+
+    // every placement of a display-sized image is the identity, decode in place
+    if (width == display.width && height == display.height) {
+        DecodeImageInto(view, image_path, metadata, scale_denom);
+        return;
+    }
+
+    // the scratch mapping is reused by the next decode of a similar size
+    MemoryBufferHandle source = AcquireMemoryBuffer(static_cast<size_t>(width) * height * 3);
+    PixelView source_view = { GetMemoryBuffer(source).ptr, static_cast<ptrdiff_t>(width) * 3, static_cast<uint16_t>(width), static_cast<uint16_t>(height) };
+
+    try {
+        DecodeImageInto(source_view, image_path, metadata, scale_denom);
+
+        WF_LOG(LogLevel::LINFO, "placing {}x{} image ({}) on display {} with {}", width, height, image_path, display.id, GetPlacementVariant(placement, filter));
+        PlaceImage(source_view, view, placement, filter);
+    } catch (...) {
+        ReleaseMemoryBuffer(source);
+        throw;
+    }
+
+    ReleaseMemoryBuffer(source);
 }
 
-void ApplyWallpaper(std::string path)
+// only the decoded-image cache keeps a copy of a composed region, nothing is
+// allocated for it when the cache would not hold the image anyway
+void CacheWallpaperBufferRegion(PixelView view, const std::string& image_path, const std::string& variant)
 {
-    if (!SystemParametersInfoW(SPI_SETDESKWALLPAPER, 0, const_cast<wchar_t*>(StringToWString(path).c_str()), SPIF_UPDATEINIFILE)) {
-        throw std::exception("Could not apply wallpaper");
+    size_t row_size = static_cast<size_t>(view.width) * 3;
+    if (!FitsDecodedImageCache(row_size * view.height)) {
+        return;
     }
+
+    std::shared_ptr<DecodedImage> image = std::make_shared<DecodedImage>();
+    image->width = view.width;
+    image->height = view.height;
+    image->pixels.reserve(row_size * view.height);
+
+    for (int y = 0; y < view.height; y++) {
+        const uint8_t* row = view.data + y * view.stride;
+        image->pixels.insert(image->pixels.end(), row, row + row_size);
+    }
+
+    CacheImage(image_path, view.width, view.height, variant, image);
 }
 
-void ApplyImageToWallpaperBuffer(uint8_t* buffer, std::string image_path, Display display, Dimensions canvas_size)
+void ApplyImageToWallpaperBuffer(const Canvas& canvas, std::string image_path, Display display)
 {
+    WF_TRACE_SCOPE("ApplyImageToWallpaperBuffer");
+    PixelView view = GetCanvasView(canvas, display);
+
     do {
         if (image_path == "") {
-            WF_LOG(LogLevel::LINFO, std::format("no image found for display {}", display.id));
-            ApplyPlaceholderToWallpaperBuffer(buffer, display, canvas_size);
+            WF_LOG(LogLevel::LINFO, "no image found for display {}", display.id);
+            ApplyPlaceholderToWallpaperBuffer(view);
             break;
         }
 
-        ImageInfo info = getImageInfo<IIFilePathReader>(image_path);
+        Placement placement = GetDisplayPlacement(display);
+        ResampleFilter filter = GetConfiguredResampleFilter();
+        std::string variant = GetPlacementVariant(placement, filter);
+
+        std::shared_ptr<const DecodedImage> image = GetCachedImage(image_path, display.width, display.height, variant);
+        if (image) {
+            WF_LOG(LogLevel::LINFO, "applying cached image ({}) to display {}", image_path, display.id);
+            BlitImageToWallpaperBuffer(view, *image);
+            break;
+        }
+
+        if (LoadDerivative(image_path, variant, view)) {
+            WF_LOG(LogLevel::LINFO, "applied stored derivative of ({}) to display {}", image_path, display.id);
+            CacheWallpaperBufferRegion(view, image_path, variant);
+            break;
+        }
 
-        if (info.getFormat() == II_FORMAT_PNG) {
-            WF_LOG(LogLevel::LINFO, std::format("applying image ({}) to display {}", image_path, display.id));
-            ApplyPNGToWallpaperBuffer(buffer, image_path, display, canvas_size);
+        ImageMetadata metadata;
+        if (!GetImageMetadata(image_path, metadata)) {
+            WF_LOG(LogLevel::LWARNING, "could not read image ({}), drawing placeholder on display {}", image_path, display.id);
+            ApplyPlaceholderToWallpaperBuffer(view);
             break;
         }
+
+        if (metadata.verified) {
+            WF_LOG(LogLevel::LINFO, "applying image ({}) to display {}", image_path, display.id);
+            try {
+                DecodeImageToWallpaperBuffer(view, image_path, metadata, display, placement, filter);
+            } catch (const std::exception& ex) {
+                // one broken file only costs its own display, the others still compose
+                WF_LOG(LogLevel::LWARNING, "{}, drawing placeholder on display {}", ex.what(), display.id);
+                ApplyPlaceholderToWallpaperBuffer(view);
+                break;
+            }
+            CacheWallpaperBufferRegion(view, image_path, variant);
+            StoreDerivative(image_path, variant, view);
+            break;
+        }
+
+        // the region is marked clean after this, it must not keep the previous image
+        WF_LOG(LogLevel::LWARNING, "image ({}) failed verification, drawing placeholder on display {}", image_path, display.id);
+        ApplyPlaceholderToWallpaperBuffer(view);
     } while (false);
 }
 
+void ComposeDirtyDisplays(Canvas& canvas, const std::vector<CompositeJob>& jobs)
+{
+    WF_TRACE_SCOPE("ComposeDirtyDisplays");
+    std::vector<CompositeJob> dirty_jobs;
+
+    for (const CompositeJob& job : jobs) {
+        if (IsRegionDirty(canvas, job.display, job.imagePath)) {
+            MarkRegionDirty(canvas, job.display);
+            dirty_jobs.push_back(job);
+        }
+    }
+
+    WF_LOG(LogLevel::LINFO, "recompositing {} of {} displays", dirty_jobs.size(), jobs.size());
+
+    // every display owns a disjoint rectangle of the canvas, so the decodes can
+    // run side by side without any locking on the buffer
+    std::vector<uint8_t> composed(dirty_jobs.size(), 0);
+
+    auto mark_composed = [&]() {
+        for (size_t i = 0; i < dirty_jobs.size(); i++) {
+            if (composed[i]) {
+                MarkRegionClean(canvas, dirty_jobs[i].display, dirty_jobs[i].imagePath);
+            }
+        }
+    };
+
+    try {
+        RunParallel(dirty_jobs.size(), [&](size_t i) {
+            ApplyImageToWallpaperBuffer(canvas, dirty_jobs[i].imagePath, dirty_jobs[i].display);
+            composed[i] = 1;
+        });
+    } catch (const std::exception& ex) {
+        mark_composed();
+        throw;
+    }
+
+    mark_composed();
+}
+
+std::string EncodeCanvas(const Canvas& canvas)
+{
+    static Histogram& encode_duration = GetHistogram("wallflow_encode_duration_microseconds", "Time spent encoding the canvas");
+    static Histogram& output_bytes = GetHistogram("wallflow_output_bytes", "Size of the wallpaper written by a cycle");
+
+    WF_TRACE_SCOPE("EncodeCanvas");
+    EncodeResult result = GetOutputEncoder().Encode(canvas);
+    WF_LOG_OBJ(result);
+
+    encode_duration.Record(result.elapsed.count());
+    output_bytes.Record(result.bytesWritten);
+    return result.path;
+}
+
+void ApplyOutput(const std::string& path)
+{
+    WF_TRACE_SCOPE("ApplyOutput");
+    GetWallpaperTarget().Apply(path);
+}
+
+int64_t GetHitPercent(uint64_t hits, uint64_t misses)
+{
+    return hits + misses == 0 ? 0 : static_cast<int64_t>(hits * 100 / (hits + misses));
+}
+
+void RecordCacheMetrics()
+{
+    static Gauge& decoded_hit_percent = GetGauge("wallflow_cache_hit_percent", "Share of lookups a cache served since start", "cache=\"decoded\"");
+    static Gauge& derivative_hit_percent = GetGauge("wallflow_cache_hit_percent", "Share of lookups a cache served since start", "cache=\"derivative\"");
+    static Gauge& decoded_bytes = GetGauge("wallflow_cache_bytes", "Bytes held by a cache", "cache=\"decoded\"");
+    static Gauge& derivative_bytes = GetGauge("wallflow_cache_bytes", "Bytes held by a cache", "cache=\"derivative\"");
+
+    DecodedImageCacheStats decoded_stats = GetDecodedImageCacheStats();
+    DerivativeCacheStats derivative_stats = GetDerivativeCacheStats();
+    WF_LOG_OBJ(decoded_stats);
+    WF_LOG_OBJ(derivative_stats);
+
+    decoded_hit_percent.Set(GetHitPercent(decoded_stats.hits, decoded_stats.misses));
+    derivative_hit_percent.Set(GetHitPercent(derivative_stats.hits, derivative_stats.misses));
+    decoded_bytes.Set(static_cast<int64_t>(decoded_stats.bytes));
+    derivative_bytes.Set(static_cast<int64_t>(derivative_stats.bytes));
+}
+
+Histogram& GetCycleHistogram(const std::string& kind)
+{
+    return GetHistogram("wallflow_cycle_duration_microseconds", "Time from picking images to the wallpaper being handed off", std::format("kind=\"{}\"", kind));
+}
+
 std::mutex wallpaper_cycle_mtx;
 
 void CycleAllDisplays()
 {
     std::lock_guard<std::mutex> lock(wallpaper_cycle_mtx);
-    WF_START_TIMER("CycleAllDisplays()");
-    Dimensions canvas_size = GetCanvasSize();
-    WF_LOG(LogLevel::LINFO, std::format("creating buffer for canvas size width={},height={}", canvas_size.width, canvas_size.height));
-    size_t buffer_size = canvas_size.width * canvas_size.height * 3;
-    uint16_t buffer_key = CreateFileMemoryBuffer(buffer_size);
-    FileMemoryBuffer fmb = GetFileMemoryBuffer(buffer_key);
+    static Histogram& cycle_duration = GetCycleHistogram("all");
+    HistogramTimer cycle_timer(cycle_duration);
+    WF_TRACE_SCOPE("CycleAllDisplays");
+    Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, GetOutputEncoder().EncodesInPlace());
+    WF_LOG_OBJ(canvas);
 
-    std::vector<std::thread> threads;
+    std::vector<CompositeJob> jobs;
 
     for (Display display : displays) {
         std::string current_wallpaper = GetNextImage(display.width, display.height);
         current_wallpapers[display.id] = current_wallpaper;
-        ApplyImageToWallpaperBuffer(fmb.ptr, current_wallpaper, display, canvas_size);
+        jobs.push_back({ display, current_wallpaper });
     }
 
-    for (std::thread& thread : threads) {
-        thread.join();
+    ComposeDirtyDisplays(canvas, jobs);
+
+    ApplyOutput(EncodeCanvas(canvas));
+
+    RecordCacheMetrics();
+}
+
+struct PreparedCycle {
+    bool ready;
+    uint64_t displayGeneration;
+    uint64_t repoGeneration;
+    std::map<std::string, std::string> wallpapers;
+    std::string outputPath;
+};
+
+PreparedCycle prepared_cycle = {};
+
+void PrepareCycleAllDisplays()
+{
+    std::lock_guard<std::mutex> lock(wallpaper_cycle_mtx);
+    static Histogram& cycle_duration = GetCycleHistogram("prepared");
+    HistogramTimer cycle_timer(cycle_duration);
+    WF_TRACE_SCOPE("PrepareCycleAllDisplays");
+    prepared_cycle = {};
+    Canvas& canvas = AcquireBackCanvas(GetCanvasSize(), displays, GetOutputEncoder().EncodesInPlace());
+    WF_LOG_OBJ(canvas);
+
+    std::vector<CompositeJob> jobs;
+    std::map<std::string, std::string> wallpapers;
+
+    for (Display display : displays) {
+        std::string next_wallpaper = GetNextImage(display.width, display.height);
+        wallpapers[display.id] = next_wallpaper;
+        jobs.push_back({ display, next_wallpaper });
     }
 
-    std::string wallpaper_path = GetAppDataPath("wallpaper.bmp");
+    // taken after picking, GetNextImage may itself repopulate a repo
+    uint64_t display_generation = GetDisplayGeneration();
+    uint64_t repo_generation = GetRepoGeneration();
 
-    // WritePNGFile(wallpaper_path, fmb.ptr, canvas_size.width, canvas_size.height);
-    stbi_write_bmp(wallpaper_path.c_str(), canvas_size.width, canvas_size.height, 3, fmb.ptr);
-    DeleteFileMemoryBuffer(buffer_key);
-    SetWallpaperStyleToSpan();
-    ApplyWallpaper(wallpaper_path);
+    ComposeDirtyDisplays(canvas, jobs);
 
-    WF_END_TIMER("CycleAllDisplays()");
+    std::string output_path = EncodeCanvas(canvas);
+
+    prepared_cycle = { true, display_generation, repo_generation, wallpapers, output_path };
+
+    RecordCacheMetrics();
 }
 
-void CycleDisplay(Display selected_display)
+bool CommitPreparedCycle()
+{
+    std::lock_guard<std::mutex> lock(wallpaper_cycle_mtx);
+
+    if (!prepared_cycle.ready) {
+        return false;
+    }
+    prepared_cycle.ready = false;
+
+    if (prepared_cycle.displayGeneration != GetDisplayGeneration() || prepared_cycle.repoGeneration != GetRepoGeneration()) {
+        WF_LOG(LogLevel::LINFO, "displays or repos changed since the cycle was prepared, discarding it");
+        return false;
+    }
+
+    static Histogram& cycle_duration = GetCycleHistogram("commit");
+    HistogramTimer cycle_timer(cycle_duration);
+    WF_TRACE_SCOPE("CommitPreparedCycle");
+    SwapCanvases();
+    current_wallpapers = prepared_cycle.wallpapers;
+    ApplyOutput(prepared_cycle.outputPath);
+
+    return true;
+}
+
+void CycleDisplays(const std::vector<Display>& selected_displays)
 {
     std::lock_guard<std::mutex> lock(wallpaper_cycle_mtx);
-    WF_START_TIMER(std::format("CycleDisplay({})", selected_display.alias));
-    Dimensions canvas_size = GetCanvasSize();
-    size_t buffer_size = canvas_size.width * canvas_size.height * 3;
-    uint16_t buffer_key = CreateFileMemoryBuffer(buffer_size);
-    FileMemoryBuffer fmb = GetFileMemoryBuffer(buffer_key);
+    static Histogram& cycle_duration = GetCycleHistogram("display");
+    HistogramTimer cycle_timer(cycle_duration);
+    WF_TRACE_SCOPE("CycleDisplays");
+    Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, GetOutputEncoder().EncodesInPlace());
+    WF_LOG_OBJ(canvas);
 
-    std::vector<std::thread> threads;
+    std::vector<CompositeJob> jobs;
 
     for (Display display : displays) {
-        if (display.id == selected_display.id) {
+        bool selected = std::any_of(selected_displays.begin(), selected_displays.end(), [&](const Display& selected_display) {
+            return selected_display.id == display.id;
+        });
+        if (selected) {
             current_wallpapers[display.id] = GetNextImage(display.width, display.height);
         }
-        ApplyImageToWallpaperBuffer(fmb.ptr, current_wallpapers[display.id], display, canvas_size);
+        jobs.push_back({ display, current_wallpapers[display.id] });
     }
 
-    for (std::thread& thread : threads) {
-        thread.join();
-    }
+    ComposeDirtyDisplays(canvas, jobs);
 
-    std::string wallpaper_path = GetAppDataPath("wallpaper.bmp");
-    stbi_write_bmp(wallpaper_path.c_str(), canvas_size.width, canvas_size.height, 3, fmb.ptr);
+    ApplyOutput(EncodeCanvas(canvas));
 
-    DeleteFileMemoryBuffer(buffer_key);
-    SetWallpaperStyleToSpan();
-    ApplyWallpaper(wallpaper_path);
+    RecordCacheMetrics();
+}
 
-    WF_END_TIMER(std::format("CycleDisplay({})", selected_display.alias));
+void CycleDisplay(Display selected_display)
+{
+    CycleDisplays({ selected_display });
 }
 
 void RedrawCurrent()
 {
+    std::lock_guard<std::mutex> lock(wallpaper_cycle_mtx);
+    static Histogram& cycle_duration = GetCycleHistogram("redraw");
+    HistogramTimer cycle_timer(cycle_duration);
+    WF_TRACE_SCOPE("RedrawCurrent");
+    Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, GetOutputEncoder().EncodesInPlace());
+    WF_LOG_OBJ(canvas);
+
+    std::vector<CompositeJob> jobs;
+
+    for (Display display : displays) {
+        if (current_wallpapers.find(display.id) == current_wallpapers.end()) {
+            current_wallpapers[display.id] = GetNextImage(display.width, display.height);
+        }
+        jobs.push_back({ display, current_wallpapers[display.id] });
+    }
+
+    ComposeDirtyDisplays(canvas, jobs);
+
+    ApplyOutput(EncodeCanvas(canvas));
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,572 @@
+#include "watch.h"
+#include "config.h"
+#include "log.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#ifdef _WIN32
+#include "convert.h"
+
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace wallflow {
+
+struct WatchedDirectory {
+    std::string path;
+    bool active;
+    bool rescan;
+    std::set<std::string> changed;
+    std::chrono::steady_clock::time_point lastScan;
+#ifdef _WIN32
+    HANDLE handle;
+    OVERLAPPED overlapped;
+    // ReadDirectoryChangesW wants a DWORD aligned buffer
+    std::vector<DWORD> buffer;
+#else
+    int descriptor;
+    // inotify is not recursive, every folder below the root has a watch of its own
+    std::map<int, std::string> subdirs;
+#endif
+};
+
+std::map<std::string, WatchedDirectory> watched_directories;
+std::thread directory_watcher;
+std::atomic<bool> directory_watcher_stopping = false;
+bool directory_watcher_started = false;
+bool directory_watcher_available = false;
+
+std::mutex directory_watch_mtx;
+
+std::string DirectoryChanges::ToString()
+{
+    return std::format("DirectoryChanges(rescan={},paths={})", rescan, paths.size());
+}
+
+#ifdef _WIN32
+
+// 64 KiB is the most ReadDirectoryChangesW accepts for network shares
+const size_t watch_buffer_size = 64 * 1024;
+const DWORD watch_filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+HANDLE watch_wake_event = NULL;
+
+bool InitDirectoryWatcher()
+{
+    watch_wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    return watch_wake_event != NULL;
+}
+
+void WakeDirectoryWatcher()
+{
+    SetEvent(watch_wake_event);
+}
+
+bool ArmDirectoryWatch(WatchedDirectory& dir)
+{
+    ResetEvent(dir.overlapped.hEvent);
+    // repos are walked recursively, so changes anywhere below count
+    return ReadDirectoryChangesW(dir.handle, dir.buffer.data(), static_cast<DWORD>(dir.buffer.size() * sizeof(DWORD)), TRUE, watch_filter, NULL, &dir.overlapped, NULL);
+}
+
+bool OpenDirectoryWatch(WatchedDirectory& dir)
+{
+    size_t active = 0;
+    for (const auto& pair : watched_directories) {
+        active += pair.second.active ? 1 : 0;
+    }
+    // one wait slot is taken by the wake event
+    if (active + 1 >= MAXIMUM_WAIT_OBJECTS) {
+        return false;
+    }
+
+    std::wstring wpath = StringToWString(dir.path);
+    dir.handle = CreateFileW(wpath.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (dir.handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    dir.overlapped = {};
+    dir.overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    dir.buffer.resize(watch_buffer_size / sizeof(DWORD));
+
+    if (dir.overlapped.hEvent == NULL || !ArmDirectoryWatch(dir)) {
+        if (dir.overlapped.hEvent != NULL) {
+            CloseHandle(dir.overlapped.hEvent);
+        }
+        CloseHandle(dir.handle);
+        return false;
+    }
+    return true;
+}
+
+void CloseDirectoryWatch(WatchedDirectory& dir)
+{
+    DWORD bytes;
+    CancelIoEx(dir.handle, &dir.overlapped);
+    // the kernel may still write into the buffer until the cancellation completes
+    GetOverlappedResult(dir.handle, &dir.overlapped, &bytes, TRUE);
+    CloseHandle(dir.overlapped.hEvent);
+    CloseHandle(dir.handle);
+}
+
+void CloseDirectoryWatcher()
+{
+    CloseHandle(watch_wake_event);
+    watch_wake_event = NULL;
+}
+
+// expects directory_watch_mtx to be held
+void ReadDirectoryEvents(WatchedDirectory& dir)
+{
+    DWORD bytes = 0;
+
+    if (!GetOverlappedResult(dir.handle, &dir.overlapped, &bytes, FALSE) || bytes == 0) {
+        // the buffer overflowed and the individual changes are lost
+        WF_LOG(LogLevel::LWARNING, "directory watch for {} overflowed", dir.path);
+        dir.rescan = true;
+    } else {
+        const uint8_t* entry = reinterpret_cast<const uint8_t*>(dir.buffer.data());
+        while (true) {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+            std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+            dir.changed.insert((std::filesystem::path(dir.path) / WStringToString(name)).string());
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            entry += info->NextEntryOffset;
+        }
+    }
+
+    if (!ArmDirectoryWatch(dir)) {
+        WF_LOG(LogLevel::LWARNING, "could not rearm directory watch for {}", dir.path);
+        CloseHandle(dir.overlapped.hEvent);
+        CloseHandle(dir.handle);
+        dir.active = false;
+        dir.rescan = true;
+    }
+}
+
+void RunDirectoryWatcher()
+{
+    SetTraceThreadName("watcher");
+    while (!directory_watcher_stopping) {
+        std::vector<HANDLE> events = { watch_wake_event };
+        std::vector<std::string> paths = { "" };
+        {
+            std::lock_guard<std::mutex> lock(directory_watch_mtx);
+            for (const auto& pair : watched_directories) {
+                if (pair.second.active) {
+                    events.push_back(pair.second.overlapped.hEvent);
+                    paths.push_back(pair.first);
+                }
+            }
+        }
+
+        DWORD result = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, INFINITE);
+        if (result == WAIT_FAILED) {
+            WF_LOG(LogLevel::LERROR, "waiting for directory changes failed");
+            break;
+        }
+
+        // the wake event only means the set of watches changed
+        size_t index = result - WAIT_OBJECT_0;
+        if (index == 0 || index >= events.size()) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(directory_watch_mtx);
+        auto it = watched_directories.find(paths[index]);
+        if (it != watched_directories.end() && it->second.active) {
+            ReadDirectoryEvents(it->second);
+        }
+    }
+}
+
+#else
+
+int watch_inotify = -1;
+int watch_wake_pipe[2] = { -1, -1 };
+// overlapping roots get the same descriptor for a folder, it is only removed once no root uses it
+std::map<int, int> watch_descriptor_refs;
+
+bool InitDirectoryWatcher()
+{
+    watch_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_inotify < 0) {
+        return false;
+    }
+    if (pipe2(watch_wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        close(watch_inotify);
+        watch_inotify = -1;
+        return false;
+    }
+    return true;
+}
+
+void WakeDirectoryWatcher()
+{
+    char byte = 0;
+    [[maybe_unused]] ssize_t written = write(watch_wake_pipe[1], &byte, 1);
+}
+
+// expects directory_watch_mtx to be held
+void ReleaseWatch(int descriptor)
+{
+    auto it = watch_descriptor_refs.find(descriptor);
+    if (it == watch_descriptor_refs.end()) {
+        return;
+    }
+    if (--it->second == 0) {
+        inotify_rm_watch(watch_inotify, descriptor);
+        watch_descriptor_refs.erase(it);
+    }
+}
+
+const uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// expects directory_watch_mtx to be held, false when there is nothing new to walk below the folder
+bool AddSubdirectoryWatch(WatchedDirectory& dir, const std::string& path)
+{
+    int descriptor = inotify_add_watch(watch_inotify, path.c_str(), watch_mask);
+    if (descriptor < 0) {
+        WF_LOG(LogLevel::LWARNING, "could not watch {} ({}), changes in it wait for the periodic rescan", path, strerror(errno));
+        return false;
+    }
+
+    // a folder reached again through a link already has a watch, and so does everything below it
+    if (descriptor == dir.descriptor || dir.subdirs.find(descriptor) != dir.subdirs.end()) {
+        return false;
+    }
+    dir.subdirs[descriptor] = path;
+    watch_descriptor_refs[descriptor]++;
+    return true;
+}
+
+// expects directory_watch_mtx to be held, links are followed like the repo walker follows them
+void AddSubdirectoryWatches(WatchedDirectory& dir, const std::string& path)
+{
+    std::vector<std::string> pending = { path };
+
+    while (!pending.empty()) {
+        std::string current = std::move(pending.back());
+        pending.pop_back();
+
+        std::error_code ec;
+        std::filesystem::directory_iterator it(current, std::filesystem::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            std::error_code type_ec;
+            if (!it->is_directory(type_ec)) {
+                continue;
+            }
+            std::string subdir = it->path().string();
+            if (AddSubdirectoryWatch(dir, subdir)) {
+                pending.push_back(subdir);
+            }
+        }
+    }
+}
+
+// expects directory_watch_mtx to be held, drops the watches of a folder that left the tree and everything below it
+void RemoveSubdirectoryWatches(WatchedDirectory& dir, const std::string& path)
+{
+    std::string prefix = path + "/";
+
+    for (auto it = dir.subdirs.begin(); it != dir.subdirs.end();) {
+        if (it->second == path || it->second.starts_with(prefix)) {
+            ReleaseWatch(it->first);
+            it = dir.subdirs.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+bool OpenDirectoryWatch(WatchedDirectory& dir)
+{
+    dir.subdirs.clear();
+    dir.descriptor = inotify_add_watch(watch_inotify, dir.path.c_str(), watch_mask);
+    if (dir.descriptor < 0) {
+        return false;
+    }
+    watch_descriptor_refs[dir.descriptor]++;
+
+    AddSubdirectoryWatches(dir, dir.path);
+    WF_LOG(LogLevel::LINFO, "watching {} folders below {}", dir.subdirs.size(), dir.path);
+    return true;
+}
+
+void CloseDirectoryWatch(WatchedDirectory& dir)
+{
+    for (const auto& pair : dir.subdirs) {
+        ReleaseWatch(pair.first);
+    }
+    dir.subdirs.clear();
+    ReleaseWatch(dir.descriptor);
+}
+
+void CloseDirectoryWatcher()
+{
+    close(watch_inotify);
+    close(watch_wake_pipe[0]);
+    close(watch_wake_pipe[1]);
+    watch_inotify = -1;
+    watch_wake_pipe[0] = watch_wake_pipe[1] = -1;
+    watch_descriptor_refs.clear();
+}
+
+// expects directory_watch_mtx to be held
+void ReadDirectoryEvents(const char* buffer, ssize_t length)
+{
+    const char* end = buffer + length;
+
+    for (const char* ptr = buffer; ptr < end;) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+        ptr += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            // events were dropped and there is no telling for which directory
+            WF_LOG(LogLevel::LWARNING, "inotify queue overflowed");
+            for (auto& pair : watched_directories) {
+                pair.second.rescan = true;
+            }
+            continue;
+        }
+
+        // overlapping roots share the watches of the folders they have in common
+        for (auto& pair : watched_directories) {
+            WatchedDirectory& dir = pair.second;
+            if (!dir.active) {
+                continue;
+            }
+
+            std::string event_dir;
+            if (dir.descriptor == event->wd) {
+                if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    WF_LOG(LogLevel::LWARNING, "directory watch for {} was removed", dir.path);
+                    for (const auto& subdir : dir.subdirs) {
+                        ReleaseWatch(subdir.first);
+                    }
+                    dir.subdirs.clear();
+                    ReleaseWatch(dir.descriptor);
+                    dir.active = false;
+                    dir.rescan = true;
+                    continue;
+                }
+                event_dir = dir.path;
+            } else {
+                auto it = dir.subdirs.find(event->wd);
+                if (it == dir.subdirs.end()) {
+                    continue;
+                }
+                // a folder going away is reported, and its watches dropped, through its parent
+                if (event->mask & IN_IGNORED) {
+                    dir.subdirs.erase(it);
+                    continue;
+                }
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    continue;
+                }
+                event_dir = it->second;
+            }
+
+            if (event->len == 0) {
+                continue;
+            }
+
+            std::string path = (std::filesystem::path(event_dir) / event->name).string();
+            dir.changed.insert(path);
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    RemoveSubdirectoryWatches(dir, path);
+                }
+                if (event->mask & (IN_CREATE | IN_MOVED_TO) && AddSubdirectoryWatch(dir, path)) {
+                    AddSubdirectoryWatches(dir, path);
+                }
+            }
+        }
+
+        // the kernel already dropped the watch, whichever roots still referenced it
+        if (event->mask & IN_IGNORED) {
+            watch_descriptor_refs.erase(event->wd);
+        }
+    }
+}
+
+void RunDirectoryWatcher()
+{
+    SetTraceThreadName("watcher");
+    alignas(inotify_event) char buffer[64 * 1024];
+
+    while (!directory_watcher_stopping) {
+        pollfd fds[2] = { { watch_inotify, POLLIN, 0 }, { watch_wake_pipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            WF_LOG(LogLevel::LERROR, "waiting for directory changes failed");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(watch_wake_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t length;
+            while ((length = read(watch_inotify, buffer, sizeof(buffer))) > 0) {
+                std::lock_guard<std::mutex> lock(directory_watch_mtx);
+                ReadDirectoryEvents(buffer, length);
+            }
+        }
+    }
+}
+
+#endif
+
+// expects directory_watch_mtx to be held
+void StartDirectoryWatcher()
+{
+    if (directory_watcher_started) {
+        return;
+    }
+    directory_watcher_started = true;
+
+    directory_watcher_available = InitDirectoryWatcher();
+    if (!directory_watcher_available) {
+        WF_LOG(LogLevel::LWARNING, "directory watching is unavailable, repos are rescanned every cycle");
+        return;
+    }
+
+    directory_watcher_stopping = false;
+    directory_watcher = std::thread(RunDirectoryWatcher);
+}
+
+void WatchDirectory(const std::string& dir_path)
+{
+    std::lock_guard<std::mutex> lock(directory_watch_mtx);
+
+    StartDirectoryWatcher();
+
+    auto it = watched_directories.find(dir_path);
+    if (it != watched_directories.end() && it->second.active) {
+        return;
+    }
+
+    WatchedDirectory& dir = watched_directories[dir_path];
+    dir.path = dir_path;
+    dir.rescan = false;
+    dir.lastScan = std::chrono::steady_clock::now();
+    dir.active = directory_watcher_available && OpenDirectoryWatch(dir);
+
+    if (!dir.active) {
+        WF_LOG(LogLevel::LWARNING, "could not watch {}, it is rescanned every cycle", dir_path);
+        return;
+    }
+
+    WF_LOG(LogLevel::LINFO, "watching {}", dir_path);
+    WakeDirectoryWatcher();
+}
+
+void MarkDirectoryScanned(const std::string& dir_path)
+{
+    std::lock_guard<std::mutex> lock(directory_watch_mtx);
+
+    auto it = watched_directories.find(dir_path);
+    if (it == watched_directories.end()) {
+        return;
+    }
+
+    it->second.rescan = false;
+    it->second.changed.clear();
+    it->second.lastScan = std::chrono::steady_clock::now();
+}
+
+bool TakeDirectoryChanges(const std::string& dir_path, DirectoryChanges& changes)
+{
+    std::lock_guard<std::mutex> lock(directory_watch_mtx);
+
+    changes.rescan = false;
+    changes.paths.clear();
+
+    auto it = watched_directories.find(dir_path);
+    if (it == watched_directories.end() || !it->second.active) {
+        // without a watch there is nothing to go on but listing it again
+        changes.rescan = true;
+        return true;
+    }
+
+    WatchedDirectory& dir = it->second;
+    auto now = std::chrono::steady_clock::now();
+
+    // a safety net for changes that no notification reports, like some network shares
+    if (config->repoRescanInterval > 0 && now - dir.lastScan >= std::chrono::seconds(config->repoRescanInterval)) {
+        dir.rescan = true;
+    }
+
+    if (!dir.rescan && dir.changed.empty()) {
+        return false;
+    }
+
+    changes.rescan = dir.rescan;
+    changes.paths.assign(dir.changed.begin(), dir.changed.end());
+    dir.changed.clear();
+    if (dir.rescan) {
+        dir.rescan = false;
+        dir.lastScan = now;
+    }
+    return true;
+}
+
+void StopDirectoryWatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(directory_watch_mtx);
+        if (!directory_watcher_started) {
+            return;
+        }
+        directory_watcher_stopping = true;
+        if (directory_watcher_available) {
+            WakeDirectoryWatcher();
+        }
+    }
+
+    if (directory_watcher.joinable()) {
+        directory_watcher.join();
+    }
+
+    std::lock_guard<std::mutex> lock(directory_watch_mtx);
+
+    for (auto& pair : watched_directories) {
+        if (pair.second.active) {
+            CloseDirectoryWatch(pair.second);
+        }
+    }
+    watched_directories.clear();
+
+    if (directory_watcher_available) {
+        CloseDirectoryWatcher();
+    }
+    directory_watcher_started = false;
+    directory_watcher_available = false;
+}
+
+}
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include "window.h"
 #include "config.h"
 #include "convert.h"
+#include "cycles.h"
 #include "displays.h"
 #include "log.h"
 #include "mem.h"
+#include "metrics.h"
+#include "paths.h"
 #include "repo.h"
+#include "trace.h"
 #include "wallpapers.h"
 
 #include <format>
@@ -75,6 +79,11 @@ void ShowContextMenu(HWND hWnd)
 
     AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
 
+    AppendMenu(hMenu, MF_STRING, TRAY_SHOW_METRICS, L"Show Metrics");
+    AppendMenu(hMenu, MF_STRING, TRAY_EXPORT_TRACE, L"Export Trace");
+
+    AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
+
     AppendMenu(hMenu, MF_STRING, TRAY_EXIT, L"Exit");
 
     // Get the mouse cursor's position
@@ -97,32 +106,39 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         LoadDisplays();
         PopulateAllRepos();
         CycleAllDisplays();
+        RescheduleWallpaperCycles();
         break;
 
     case WM_TRAY_ICON:
         switch (lParam) {
+        case WM_MOUSEMOVE:
+            // the pointer rests on the icon before the menu opens, so edits to
+            // the alias file are picked up without the menu touching the disk
+            RefreshDisplayAliasesLater();
+            break;
         case WM_RBUTTONUP:
             ShowContextMenu(hWnd);
             break;
         }
+        break;
 
     case WM_COMMAND:
         if (LOWORD(wParam) >= TRAY_CYCLE_DISPLAY_OFFSET) {
             int display_index = LOWORD(wParam) - TRAY_CYCLE_DISPLAY_OFFSET;
-            WF_LOG(LogLevel::LINFO, std::format("cycling display {}", displays[display_index].ToString()));
+            WF_LOG(LogLevel::LINFO, "cycling display {}", displays[display_index].ToString());
             CycleDisplay(displays[display_index]);
             break;
         }
 
         switch (LOWORD(wParam)) {
         case TRAY_OPEN_CONFIG: {
-            WF_LOG(LogLevel::LINFO, "opening config file " + GetConfigPath());
+            WF_LOG(LogLevel::LINFO, "opening config file {}", GetConfigPath());
             HINSTANCE result = ShellExecuteA(NULL, NULL, GetConfigPath().c_str(), NULL, NULL, SW_SHOWNORMAL);
             break;
         }
 
         case TRAY_OPEN_ALIASES:
-            WF_LOG(LogLevel::LINFO, "opening display alias file " + GetDisplayAliasPath());
+            WF_LOG(LogLevel::LINFO, "opening display alias file {}", GetDisplayAliasPath());
             ShellExecuteA(NULL, "open", GetDisplayAliasPath().c_str(), NULL, NULL, SW_SHOWNORMAL);
             break;
 
@@ -138,6 +154,34 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             PopulateAllRepos();
             break;
 
+        case TRAY_SHOW_METRICS: {
+            WF_LOG(LogLevel::LINFO, "showing metrics");
+            // the file is brought up to date too, it is otherwise only written on exit or every metricsInterval
+            try {
+                WriteMetrics(GetAppDataPath("metrics.txt"));
+            } catch (const std::exception& ex) {
+                WF_LOG(LogLevel::LWARNING, ex.what());
+            }
+            std::string summary = GetMetricsSummary();
+            if (summary.empty()) {
+                summary = "nothing recorded yet";
+            }
+            MessageBoxW(hWnd, StringToWString(summary).c_str(), L"WallFlow Metrics", MB_OK | MB_ICONINFORMATION);
+            break;
+        }
+
+        case TRAY_EXPORT_TRACE: {
+            std::string trace_path = GetAppDataPath("trace.json");
+            try {
+                ExportTrace(trace_path);
+                std::string select_arg = std::format("/select,\"{}\"", trace_path);
+                ShellExecuteA(NULL, "open", "explorer.exe", select_arg.c_str(), NULL, SW_SHOWNORMAL);
+            } catch (const std::exception& ex) {
+                WF_LOG(LogLevel::LERROR, ex.what());
+            }
+            break;
+        }
+
         case TRAY_EXIT: // Handle Exit
             Shell_NotifyIcon(NIM_DELETE, &nid);
             PostQuitMessage(0);
@@ -194,6 +238,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 }
                 if (intValue >= 30) {
                     SetCycleSpeed(intValue);
+                    RescheduleWallpaperCycles();
                     ShowWindow(hWnd, SW_HIDE);
                 }
             } catch (const std::exception& ex) {
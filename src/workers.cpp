@@ -0,0 +1,196 @@
+#include "workers.h"
+#include "log.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <format>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace wallflow {
+
+// One RunParallel call. The caller always works on its own batch, pool threads
+// join it while it has tasks left and fewer helpers than it allows, so a call
+// made from inside a task shares the pool instead of starting threads of its own.
+struct ParallelBatch {
+    const std::function<void(size_t)>* task;
+    size_t taskCount;
+    size_t helperLimit;
+    // guarded by worker_pool_mtx
+    size_t helpers;
+    size_t running;
+    std::atomic<size_t> nextTask;
+    std::atomic<bool> failed;
+    std::exception_ptr firstError;
+    std::mutex errorMtx;
+};
+
+std::deque<ParallelBatch*> worker_batches;
+std::vector<std::thread> worker_threads;
+bool worker_pool_started = false;
+bool worker_pool_stopping = false;
+std::condition_variable worker_batch_cv;
+std::condition_variable worker_done_cv;
+
+std::mutex worker_pool_mtx;
+
+size_t GetWorkerCount(size_t task_count, size_t max_workers)
+{
+    size_t workers = std::thread::hardware_concurrency();
+    if (workers == 0) {
+        workers = 1;
+    }
+    if (max_workers > 0) {
+        workers = std::min(workers, max_workers);
+    }
+    return std::min(workers, task_count);
+}
+
+void RunBatchTasks(ParallelBatch& batch)
+{
+    while (!batch.failed) {
+        size_t index = batch.nextTask.fetch_add(1);
+        if (index >= batch.taskCount) {
+            return;
+        }
+
+        try {
+            (*batch.task)(index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(batch.errorMtx);
+            if (!batch.firstError) {
+                batch.firstError = std::current_exception();
+            }
+            batch.failed = true;
+        }
+    }
+}
+
+// expects worker_pool_mtx to be held
+ParallelBatch* FindOpenBatch()
+{
+    for (ParallelBatch* batch : worker_batches) {
+        if (batch->helpers < batch->helperLimit && !batch->failed && batch->nextTask < batch->taskCount) {
+            return batch;
+        }
+    }
+    return nullptr;
+}
+
+void RunPoolWorker()
+{
+    SetTraceThreadName("worker");
+    std::unique_lock<std::mutex> lock(worker_pool_mtx);
+
+    while (!worker_pool_stopping) {
+        ParallelBatch* batch = FindOpenBatch();
+        if (batch == nullptr) {
+            worker_batch_cv.wait(lock);
+            continue;
+        }
+
+        batch->helpers++;
+        batch->running++;
+        lock.unlock();
+        RunBatchTasks(*batch);
+        lock.lock();
+
+        if (--batch->running == 0) {
+            worker_done_cv.notify_all();
+        }
+    }
+}
+
+// expects worker_pool_mtx to be held
+void StartWorkerPool()
+{
+    if (worker_pool_started) {
+        return;
+    }
+    worker_pool_started = true;
+
+    // the thread calling RunParallel is the remaining worker
+    size_t thread_count = GetWorkerCount(SIZE_MAX) - 1;
+    worker_threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++) {
+        try {
+            worker_threads.emplace_back(RunPoolWorker);
+        } catch (const std::system_error& ex) {
+            WF_LOG(LogLevel::LWARNING, "could not start worker thread ({})", ex.what());
+            break;
+        }
+    }
+
+    WF_LOG(LogLevel::LINFO, "started {} pool workers", worker_threads.size());
+}
+
+void RunParallel(size_t task_count, const std::function<void(size_t)>& task, size_t max_workers)
+{
+    size_t worker_count = GetWorkerCount(task_count, max_workers);
+    if (worker_count == 0) {
+        return;
+    }
+
+    ParallelBatch batch;
+    batch.task = &task;
+    batch.taskCount = task_count;
+    batch.helperLimit = worker_count - 1;
+    batch.helpers = 0;
+    batch.running = 1;
+    batch.nextTask = 0;
+    batch.failed = false;
+
+    if (batch.helperLimit > 0) {
+        {
+            std::lock_guard<std::mutex> lock(worker_pool_mtx);
+            StartWorkerPool();
+            worker_batches.push_back(&batch);
+        }
+        worker_batch_cv.notify_all();
+    }
+
+    RunBatchTasks(batch);
+
+    if (batch.helperLimit > 0) {
+        std::unique_lock<std::mutex> lock(worker_pool_mtx);
+        worker_batches.erase(std::find(worker_batches.begin(), worker_batches.end(), &batch));
+        // helpers may still be inside a task they took
+        batch.running--;
+        worker_done_cv.wait(lock, [&batch] { return batch.running == 0; });
+    }
+
+    if (batch.firstError) {
+        std::rethrow_exception(batch.firstError);
+    }
+}
+
+void StopWorkerPool()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(worker_pool_mtx);
+        worker_pool_stopping = true;
+        threads = std::move(worker_threads);
+    }
+    worker_batch_cv.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// joins the pool before the globals above are destroyed
+struct WorkerPoolShutdown {
+    ~WorkerPoolShutdown()
+    {
+        StopWorkerPool();
+    }
+} worker_pool_shutdown;
+
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "kernels.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace wallflow;
+
+// Every SIMD table the CPU supports is run against the scalar one on the same
+// input, over all lengths up to a few vector widths and misaligned pointers.
+// Outputs sit between guard bytes so a kernel writing past its end fails too.
+
+const size_t max_count = 200;
+const size_t max_offset = 7;
+const size_t guard = 64;
+const uint8_t guard_byte = 0xA5;
+
+std::mt19937 rng(1234);
+int failures = 0;
+
+void Fail(const PixelKernels& kernels, const char* kernel, size_t count, size_t offset)
+{
+    if (failures++ < 20) {
+        std::printf("FAIL %s %s count=%zu offset=%zu\n", kernels.name, kernel, count, offset);
+    }
+}
+
+std::vector<uint8_t> RandomBytes(size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t& byte : bytes) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return bytes;
+}
+
+using ConvertKernel = void (*)(const uint8_t*, uint8_t*, size_t);
+
+void CheckConvert(const PixelKernels& kernels, const char* kernel, ConvertKernel actual, ConvertKernel expected, size_t src_size, size_t dst_size)
+{
+    for (size_t count = 0; count <= max_count; count++) {
+        for (size_t offset = 0; offset <= max_offset; offset++) {
+            std::vector<uint8_t> src = RandomBytes(count * src_size + offset);
+            std::vector<uint8_t> want(count * dst_size + offset + guard, guard_byte);
+            std::vector<uint8_t> got(want);
+
+            expected(src.data() + offset, want.data() + offset, count);
+            actual(src.data() + offset, got.data() + offset, count);
+
+            if (want != got) {
+                Fail(kernels, kernel, count, offset);
+            }
+        }
+    }
+}
+
+void CheckSwapRedBlueInPlace(const PixelKernels& kernels)
+{
+    for (size_t count = 0; count <= max_count; count++) {
+        for (size_t offset = 0; offset <= max_offset; offset++) {
+            std::vector<uint8_t> want = RandomBytes(count * 3 + offset + guard);
+            std::vector<uint8_t> got(want);
+
+            GetScalarKernels().swapRedBlue(want.data() + offset, want.data() + offset, count);
+            kernels.swapRedBlue(got.data() + offset, got.data() + offset, count);
+
+            if (want != got) {
+                Fail(kernels, "swapRedBlue in place", count, offset);
+            }
+        }
+    }
+}
+
+void CheckFill(const PixelKernels& kernels)
+{
+    for (size_t count = 0; count <= max_count; count++) {
+        for (size_t offset = 0; offset <= max_offset; offset++) {
+            std::vector<uint8_t> pixel = RandomBytes(3);
+            std::vector<uint8_t> want(count * 3 + offset + guard, guard_byte);
+            std::vector<uint8_t> got(want);
+
+            GetScalarKernels().fill(want.data() + offset, count, pixel.data());
+            kernels.fill(got.data() + offset, count, pixel.data());
+
+            if (want != got) {
+                Fail(kernels, "fill", count, offset);
+            }
+        }
+    }
+}
+
+void CheckSwapRows(const PixelKernels& kernels)
+{
+    for (size_t size = 0; size <= max_count * 3; size++) {
+        for (size_t offset = 0; offset <= max_offset; offset++) {
+            // both rows in one buffer, like the rows of a flipped image
+            std::vector<uint8_t> want = RandomBytes(2 * (size + offset) + guard);
+            std::vector<uint8_t> got(want);
+
+            GetScalarKernels().swapRows(want.data() + offset, want.data() + size + 2 * offset, size);
+            kernels.swapRows(got.data() + offset, got.data() + size + 2 * offset, size);
+
+            if (want != got) {
+                Fail(kernels, "swapRows", size, offset);
+            }
+        }
+    }
+}
+
+// weights that sum to one like the resampler's, with negative lobes
+std::vector<int16_t> RandomWeights(size_t outputs, int taps)
+{
+    std::vector<int16_t> weights(outputs * taps);
+    std::uniform_int_distribution<int> distribution(-4000, 12000);
+
+    for (size_t x = 0; x < outputs; x++) {
+        int sum = 0;
+        for (int k = 1; k < taps; k++) {
+            weights[x * taps + k] = static_cast<int16_t>(distribution(rng) / taps);
+            sum += weights[x * taps + k];
+        }
+        weights[x * taps] = static_cast<int16_t>((1 << resample_precision) - sum);
+    }
+    return weights;
+}
+
+void CheckResampleHorizontal(const PixelKernels& kernels)
+{
+    for (int taps = 1; taps <= 12; taps++) {
+        for (size_t src_width = taps; src_width <= 64; src_width++) {
+            size_t dst_width = src_width + taps;
+            std::vector<uint8_t> src = RandomBytes(src_width * 3);
+            std::vector<int16_t> weights = RandomWeights(dst_width, taps);
+            std::vector<int32_t> starts(dst_width);
+            for (size_t x = 0; x < dst_width; x++) {
+                // edge taps included, those are the ones the wide loads must not overrun
+                starts[x] = static_cast<int32_t>(x < src_width - taps + 1 ? x : src_width - taps);
+            }
+
+            std::vector<uint8_t> want(dst_width * 3 + guard, guard_byte);
+            std::vector<uint8_t> got(want);
+
+            GetScalarKernels().resampleHorizontal(src.data(), src_width, want.data(), dst_width, starts.data(), weights.data(), taps);
+            kernels.resampleHorizontal(src.data(), src_width, got.data(), dst_width, starts.data(), weights.data(), taps);
+
+            if (want != got) {
+                Fail(kernels, "resampleHorizontal", src_width, static_cast<size_t>(taps));
+            }
+        }
+    }
+}
+
+void CheckResampleVertical(const PixelKernels& kernels)
+{
+    for (int taps = 1; taps <= 12; taps++) {
+        for (size_t size = 0; size <= max_count; size++) {
+            for (size_t offset = 0; offset <= max_offset; offset += 3) {
+                std::vector<std::vector<uint8_t>> row_data;
+                std::vector<const uint8_t*> rows;
+                for (int k = 0; k < taps; k++) {
+                    row_data.push_back(RandomBytes(size + offset));
+                }
+                for (int k = 0; k < taps; k++) {
+                    rows.push_back(row_data[k].data() + offset);
+                }
+                std::vector<int16_t> weights = RandomWeights(1, taps);
+
+                std::vector<uint8_t> want(size + offset + guard, guard_byte);
+                std::vector<uint8_t> got(want);
+
+                GetScalarKernels().resampleVertical(rows.data(), want.data() + offset, size, weights.data(), taps);
+                kernels.resampleVertical(rows.data(), got.data() + offset, size, weights.data(), taps);
+
+                if (want != got) {
+                    Fail(kernels, "resampleVertical", size, offset);
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    const PixelKernels& scalar = GetScalarKernels();
+
+    for (const PixelKernels* kernels : GetSupportedPixelKernels()) {
+        if (kernels == &scalar) {
+            continue;
+        }
+
+        std::printf("checking %s kernels\n", kernels->name);
+        CheckConvert(*kernels, "rgbaToRgb", kernels->rgbaToRgb, scalar.rgbaToRgb, 4, 3);
+        CheckConvert(*kernels, "rgbaToBgr", kernels->rgbaToBgr, scalar.rgbaToBgr, 4, 3);
+        CheckConvert(*kernels, "swapRedBlue", kernels->swapRedBlue, scalar.swapRedBlue, 3, 3);
+        CheckConvert(*kernels, "rgbToBgrx", kernels->rgbToBgrx, scalar.rgbToBgrx, 3, 4);
+        CheckConvert(*kernels, "bgrToBgrx", kernels->bgrToBgrx, scalar.bgrToBgrx, 3, 4);
+        CheckSwapRedBlueInPlace(*kernels);
+        CheckFill(*kernels);
+        CheckSwapRows(*kernels);
+        CheckResampleHorizontal(*kernels);
+        CheckResampleVertical(*kernels);
+    }
+
+    if (failures > 0) {
+        std::printf("%d mismatches against the scalar kernels\n", failures);
+        return 1;
+    }
+
+    std::printf("all kernels match the scalar reference\n");
+    return 0;
+}
\ No newline at end of file
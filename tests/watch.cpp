@@ -0,0 +1,134 @@
+#include "config.h"
+#include "watch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace wallflow;
+
+// Files are created and removed in a temporary directory, in a folder that
+// existed before the watch and in one made after it, and every change has to
+// come back from TakeDirectoryChanges without falling back to a rescan. A
+// second root reached through a link from the first shares its watch, and has
+// to keep it when the first root goes away.
+
+const auto change_timeout = std::chrono::seconds(5);
+
+int failures = 0;
+
+void Fail(const std::string& message)
+{
+    failures++;
+    std::printf("FAIL %s\n", message.c_str());
+}
+
+void WriteFile(const std::filesystem::path& path)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << "wallflow";
+}
+
+// collects changes until path shows up, the watcher thread reports them asynchronously
+bool WaitForChange(const std::filesystem::path& root, const std::filesystem::path& path)
+{
+    auto deadline = std::chrono::steady_clock::now() + change_timeout;
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        DirectoryChanges changes;
+        if (TakeDirectoryChanges(root.string(), changes)) {
+            if (changes.rescan) {
+                Fail("watch fell back to a rescan for " + path.string());
+                return false;
+            }
+            if (std::find(changes.paths.begin(), changes.paths.end(), path.string()) != changes.paths.end()) {
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    Fail("no change reported for " + path.string());
+    return false;
+}
+
+int main()
+{
+    config = new Config();
+    // only notifications count, the periodic rescan would hide a missing watch
+    config->repoRescanInterval = 0;
+
+    std::filesystem::path root = std::filesystem::temp_directory_path() / std::format("wallflow_watch_{:x}", std::random_device {}());
+    std::filesystem::path existing = root / "existing";
+    std::filesystem::create_directories(existing);
+
+    WatchDirectory(root.string());
+    MarkDirectoryScanned(root.string());
+
+    DirectoryChanges changes;
+    if (TakeDirectoryChanges(root.string(), changes)) {
+        Fail("changes reported before anything changed");
+    }
+
+    WriteFile(root / "top.png");
+    WaitForChange(root, root / "top.png");
+
+    WriteFile(existing / "nested.png");
+    WaitForChange(root, existing / "nested.png");
+
+    std::filesystem::remove(existing / "nested.png");
+    WaitForChange(root, existing / "nested.png");
+
+    // a folder made after the watch reports itself, and is watched from then on
+    std::filesystem::path added = root / "added";
+    std::filesystem::create_directory(added);
+    if (WaitForChange(root, added)) {
+        WriteFile(added / "late.jpg");
+        WaitForChange(root, added / "late.jpg");
+    }
+
+    std::filesystem::remove_all(added);
+    WaitForChange(root, added);
+
+    std::filesystem::path library = root.string() + "_library";
+    std::filesystem::path linking = root.string() + "_linking";
+    std::filesystem::path moved = root.string() + "_moved";
+    std::filesystem::create_directory(library);
+    std::filesystem::create_directory(linking);
+
+    std::error_code ec;
+    std::filesystem::create_directory_symlink(library, linking / "linked", ec);
+    if (ec) {
+        std::printf("skipping shared watches, links cannot be made here (%s)\n", ec.message().c_str());
+    } else {
+        WatchDirectory(library.string());
+        MarkDirectoryScanned(library.string());
+        WatchDirectory(linking.string());
+        MarkDirectoryScanned(linking.string());
+
+        // dropping the linking root must leave the watch of the library root alone
+        std::filesystem::rename(linking, moved);
+        WriteFile(library / "shared.png");
+        WaitForChange(library, library / "shared.png");
+    }
+
+    StopDirectoryWatcher();
+    std::filesystem::remove_all(root);
+    std::filesystem::remove_all(library);
+    std::filesystem::remove_all(linking);
+    std::filesystem::remove_all(moved);
+
+    if (failures > 0) {
+        std::printf("%d directory watch checks failed\n", failures);
+        return 1;
+    }
+
+    std::printf("all directory changes were reported\n");
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "canvas.h"
+#include "config.h"
+#include "displays.h"
+#include "encoders.h"
+#include "log.h"
+#include "mem.h"
+#include "metrics.h"
+#include "paths.h"
+#include "platform.h"
+#include "repo.h"
+#include "trace.h"
+#include "wallpapers.h"
+#include "watch.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using namespace wallflow;
+
+struct RenderOptions {
+    std::string layoutPath;
+    std::string outputPath;
+    std::string format;
+    std::string wallpaperDir;
+    std::string tracePath;
+    std::string metricsPath;
+    std::string dataDir;
+    unsigned int count = 1;
+};
+
+struct RenderLayout {
+    std::vector<Display> displays;
+    // display id to the image it always shows, the others cycle through their repo
+    std::map<std::string, std::string> images;
+};
+
+const char* usage = "usage: wallflow-render --layout <layout.json> --output <file> [--count <n>] [--format bmp|png|jpg|raw] [--wallpaper-dir <dir>] [--trace <trace.json>] [--metrics <metrics.txt>] [--data-dir <dir>]\n"
+                    "\n"
+                    "layout.json: {\"displays\": [{\"id\": \"left\", \"x\": 0, \"y\": 0, \"width\": 2560, \"height\": 1440, \"image\": \"a.jpg\", \"placement\": \"fit\"}]}\n"
+                    "id, image and placement are optional. With --count above 1 the output path may contain {} for the frame number,\n"
+                    "otherwise the number is appended to the file name. --trace writes the recorded spans as Chrome trace event JSON,\n"
+                    "--metrics the counters and latency summaries in the OpenMetrics text format. Config, logs and caches go to\n"
+                    "--data-dir, by default wallflow-render in the temp directory, never to the data of the installed app.\n";
+
+RenderOptions ParseRenderOptions(int argc, char** argv)
+{
+    RenderOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error(std::format("missing value for {}", arg));
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--layout") {
+            options.layoutPath = value;
+        } else if (arg == "--output") {
+            options.outputPath = value;
+        } else if (arg == "--format") {
+            options.format = value;
+        } else if (arg == "--wallpaper-dir") {
+            options.wallpaperDir = value;
+        } else if (arg == "--trace") {
+            options.tracePath = value;
+        } else if (arg == "--metrics") {
+            options.metricsPath = value;
+        } else if (arg == "--data-dir") {
+            options.dataDir = value;
+        } else if (arg == "--count") {
+            options.count = static_cast<unsigned int>(std::stoul(value));
+        } else {
+            throw std::runtime_error(std::format("unknown option {}", arg));
+        }
+    }
+
+    if (options.layoutPath.empty() || options.outputPath.empty()) {
+        throw std::runtime_error("--layout and --output are required");
+    }
+    if (options.count == 0) {
+        throw std::runtime_error("--count must be at least 1");
+    }
+
+    if (options.dataDir.empty()) {
+        options.dataDir = (std::filesystem::temp_directory_path() / "wallflow-render").string();
+    }
+
+    // the output extension picks the encoder unless told otherwise
+    if (options.format.empty()) {
+        options.format = std::filesystem::path(options.outputPath).extension().string();
+        if (!options.format.empty()) {
+            options.format.erase(0, 1);
+        }
+    }
+    return options;
+}
+
+RenderLayout LoadRenderLayout(const std::string& layout_path)
+{
+    std::ifstream layout_file(layout_path);
+    if (!layout_file.is_open()) {
+        throw std::runtime_error(std::format("could not open layout file ({})", layout_path));
+    }
+
+    nlohmann::json json_layout = nlohmann::json::parse(layout_file);
+    RenderLayout layout;
+
+    for (const nlohmann::json& json_display : json_layout.at("displays")) {
+        Display display;
+        display.width = json_display.at("width").get<uint16_t>();
+        display.height = json_display.at("height").get<uint16_t>();
+        display.x = json_display.value("x", 0);
+        display.y = json_display.value("y", 0);
+        display.repoKey = std::format("{}x{}", display.width, display.height);
+        display.id = json_display.value("id", std::format("DISPLAY{}:{}", layout.displays.size(), display.repoKey));
+        display.alias = display.id;
+
+        if (json_display.contains("image")) {
+            layout.images[display.id] = json_display["image"].get<std::string>();
+        }
+        if (json_display.contains("placement")) {
+            config->displayPlacement[display.alias] = json_display["placement"].get<std::string>();
+        }
+        layout.displays.push_back(display);
+    }
+
+    if (layout.displays.empty()) {
+        throw std::runtime_error(std::format("layout has no displays ({})", layout_path));
+    }
+    return layout;
+}
+
+std::string GetFrameOutputPath(const RenderOptions& options, unsigned int frame)
+{
+    if (options.count == 1) {
+        return options.outputPath;
+    }
+    if (options.outputPath.find("{}") != std::string::npos) {
+        return std::vformat(options.outputPath, std::make_format_args(frame));
+    }
+
+    std::filesystem::path path(options.outputPath);
+    std::string name = std::format("{}_{:04}{}", path.stem().string(), frame, path.extension().string());
+    return path.replace_filename(name).string();
+}
+
+void Render(const RenderOptions& options)
+{
+    SetAppDataDir(options.dataDir);
+    CreateAppDataDir();
+    SetLogDirectory(GetAppDataPath("logs"));
+
+    // a fresh data directory gets the defaults instead of the directory picker
+    if (!std::filesystem::exists(GetConfigPath())) {
+        CreateDefaultConfig(options.wallpaperDir.empty() ? std::filesystem::current_path().string() : options.wallpaperDir);
+    }
+    LoadConfig();
+
+    if (!options.wallpaperDir.empty()) {
+        config->wallpaperDir = options.wallpaperDir;
+        config->wallpaperDirs = {};
+    }
+
+    RenderLayout layout = LoadRenderLayout(options.layoutPath);
+    SetDisplaySource(CreateStaticDisplaySource(layout.displays));
+    LoadDisplays();
+
+    std::unique_ptr<OutputEncoder> encoder = CreateOutputEncoder(options.format, config->jpegQuality, config->pngCompressionLevel, config->pngFilter);
+    auto started_at = std::chrono::steady_clock::now();
+
+    for (unsigned int frame = 0; frame < options.count; frame++) {
+        Canvas& canvas = AcquireCanvas(GetCanvasSize(), displays, encoder->EncodesInPlace());
+        // fixed images would leave their regions clean after the first frame, every frame composes in full
+        for (const Display& display : displays) {
+            MarkRegionDirty(canvas, display);
+        }
+
+        std::vector<CompositeJob> jobs;
+        for (const Display& display : displays) {
+            auto it = layout.images.find(display.id);
+            jobs.push_back({ display, it != layout.images.end() ? it->second : GetNextImage(display.width, display.height) });
+        }
+
+        ComposeDirtyDisplays(canvas, jobs);
+        EncodeResult result = encoder->Encode(canvas);
+
+        std::string output_path = GetFrameOutputPath(options, frame);
+        CreateFileWallpaperTarget(output_path)->Apply(result.path);
+        std::cout << std::format("{} {}x{} {} bytes, encoded in {}us", output_path, canvas.size.width, canvas.size.height, result.bytesWritten, result.elapsed.count()) << std::endl;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started_at;
+    std::cout << std::format("rendered {} frames in {:.3f}s ({:.2f} frames/s)", options.count, elapsed.count(), options.count / elapsed.count()) << std::endl;
+
+    if (!options.metricsPath.empty()) {
+        WriteMetrics(options.metricsPath);
+        std::cout << std::format("wrote metrics to {}", options.metricsPath) << std::endl;
+    }
+    if (!options.tracePath.empty()) {
+        ExportTrace(options.tracePath);
+        std::cout << std::format("wrote trace to {} ({})", options.tracePath, GetTraceStats().ToString()) << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SetTraceThreadName("main");
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--help") {
+            std::cout << usage;
+            return 0;
+        }
+    }
+
+    RenderOptions options;
+    try {
+        options = ParseRenderOptions(argc, argv);
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << "\n\n"
+                  << usage;
+        return 2;
+    }
+
+    int status = 0;
+    try {
+        Render(options);
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        status = 1;
+    }
+
+    StopDirectoryWatcher();
+    ReleaseCanvases();
+    DeleteAllMemoryBuffers();
+    StopLogger();
+    return status;
+}
\ No newline at end of file